@@ -0,0 +1,337 @@
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "http_parser.h"
+
+using namespace std;
+
+static const int MAX_HEADER_NUM = 100;
+
+static bool iequals(string_view a, string_view b)
+{
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+/// 在以逗号分隔的首部值中查找token，如 "Connection: keep-alive, Upgrade"
+static bool has_token(string_view value, string_view token)
+{
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        string_view item = value.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) item.remove_suffix(1);
+        if (iequals(item, token)) {
+            return true;
+        }
+        if (comma == string_view::npos) {
+            break;
+        }
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+string_view HttpRequest::get_header(string_view name) const
+{
+    for (auto& h : headers) {
+        if (iequals(h.first, name)) {
+            return h.second;
+        }
+    }
+    return string_view();
+}
+
+void HttpRequest::clear()
+{
+    method = uri = version = body = string_view();
+    headers.clear();
+    chunks.clear();
+    content_length = 0;
+    chunked = false;
+    keep_alive = true;
+}
+
+HttpParser::HttpParser(int max_header_size, long long max_body_size)
+    : hp_max_header_size(max_header_size), hp_max_body_size(max_body_size)
+{
+    hp_headers.reserve(16);
+    hp_request.headers.reserve(16);
+}
+
+void HttpParser::reset()
+{
+    hp_state = State::RequestLine;
+    hp_pos = hp_scan = hp_consumed = 0;
+    hp_headers.clear();
+    hp_chunks.clear();
+    hp_body = { 0, 0 };
+    hp_chunk_left = 0;
+    hp_chunk_total = 0;
+    hp_content_length = -1;
+    hp_chunked = false;
+    hp_keep_alive = true;
+    hp_request.clear();
+}
+
+/// 从hp_pos开始取一行，行不包含结尾的CRLF（兼容单独的LF），取到返回true并把hp_pos移到下一行
+bool HttpParser::next_line(const char *data, int len, Span& line)
+{
+    const char *eol = static_cast<const char*>(memchr(data + hp_scan, '\n', len - hp_scan));
+    if (eol == nullptr) {
+        hp_scan = len;
+        return false;
+    }
+
+    int end = eol - data;
+    line.off = hp_pos;
+    line.len = end - hp_pos;
+    if (line.len > 0 && data[end - 1] == '\r') {
+        line.len--;
+    }
+    hp_pos = hp_scan = end + 1;
+    return true;
+}
+
+bool HttpParser::parse_request_line(const char *data, const Span& line)
+{
+    string_view s = view(data, line);
+
+    size_t sp1 = s.find(' ');
+    if (sp1 == string_view::npos || sp1 == 0) {
+        return false;
+    }
+    size_t sp2 = s.find(' ', sp1 + 1);
+    if (sp2 == string_view::npos || sp2 == sp1 + 1) {
+        return false;
+    }
+
+    hp_method = { line.off, static_cast<int>(sp1) };
+    hp_uri = { line.off + static_cast<int>(sp1) + 1, static_cast<int>(sp2 - sp1 - 1) };
+    hp_version = { line.off + static_cast<int>(sp2) + 1, static_cast<int>(s.size() - sp2 - 1) };
+
+    string_view version = view(data, hp_version);
+    if (version == "HTTP/1.1") {
+        hp_keep_alive = true;
+    }
+    else if (version == "HTTP/1.0") {
+        hp_keep_alive = false;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool HttpParser::parse_header_line(const char *data, const Span& line)
+{
+    if (hp_headers.size() >= MAX_HEADER_NUM) {
+        return false;
+    }
+
+    string_view s = view(data, line);
+    size_t colon = s.find(':');
+    if (colon == string_view::npos || colon == 0) {
+        return false;
+    }
+
+    int v_begin = colon + 1;
+    int v_end = s.size();
+    while (v_begin < v_end && (s[v_begin] == ' ' || s[v_begin] == '\t')) v_begin++;
+    while (v_end > v_begin && (s[v_end - 1] == ' ' || s[v_end - 1] == '\t')) v_end--;
+
+    Span name = { line.off, static_cast<int>(colon) };
+    Span value = { line.off + v_begin, v_end - v_begin };
+    hp_headers.emplace_back(name, value);
+
+    string_view n = view(data, name);
+    string_view v = view(data, value);
+    if (iequals(n, "Content-Length")) {
+        long long cl = 0;
+        if (v.empty()) {
+            return false;
+        }
+        for (char c : v) {
+            if (!isdigit(static_cast<unsigned char>(c))) {
+                return false;
+            }
+            cl = cl * 10 + (c - '0');
+            if (cl > hp_max_body_size) {
+                return false;
+            }
+        }
+        //多个值不同的Content-Length可能被用来走私请求
+        if (hp_content_length != -1 && hp_content_length != cl) {
+            return false;
+        }
+        hp_content_length = cl;
+    }
+    else if (iequals(n, "Transfer-Encoding")) {
+        hp_chunked = has_token(v, "chunked");
+    }
+    else if (iequals(n, "Connection")) {
+        if (has_token(v, "close")) {
+            hp_keep_alive = false;
+        }
+        else if (has_token(v, "keep-alive")) {
+            hp_keep_alive = true;
+        }
+    }
+    return true;
+}
+
+/// 把偏移转换成指向本次data的view
+void HttpParser::build_request(const char *data)
+{
+    hp_request.method = view(data, hp_method);
+    hp_request.uri = view(data, hp_uri);
+    hp_request.version = view(data, hp_version);
+    hp_request.headers.clear();
+    for (auto& h : hp_headers) {
+        hp_request.headers.emplace_back(view(data, h.first), view(data, h.second));
+    }
+    hp_request.chunks.clear();
+    hp_request.chunked = hp_chunked;
+    hp_request.keep_alive = hp_keep_alive;
+    if (hp_chunked) {
+        for (auto& c : hp_chunks) {
+            hp_request.chunks.emplace_back(view(data, c));
+        }
+        hp_request.body = string_view();
+        hp_request.content_length = hp_chunk_total;
+    }
+    else {
+        hp_request.body = view(data, hp_body);
+        hp_request.content_length = hp_body.len;
+    }
+}
+
+HttpParser::ParseResult HttpParser::parse(const char *data, int len)
+{
+    Span line;
+
+    while (true) {
+        switch (hp_state) {
+        case State::RequestLine:
+            if (!next_line(data, len, line)) {
+                return len - hp_pos > hp_max_header_size ? fail() : ParseResult::Incomplete;
+            }
+            if (line.len == 0) {
+                // RFC 7230 3.5: 忽略请求前多余的空行
+                break;
+            }
+            if (!parse_request_line(data, line)) {
+                return fail();
+            }
+            hp_state = State::Headers;
+            break;
+
+        case State::Headers:
+            if (!next_line(data, len, line)) {
+                return len > hp_max_header_size ? fail() : ParseResult::Incomplete;
+            }
+            if (hp_pos > hp_max_header_size) {
+                return fail();
+            }
+            if (line.len != 0) {
+                if (!parse_header_line(data, line)) {
+                    return fail();
+                }
+                break;
+            }
+            // 空行，首部结束
+            if (hp_chunked) {
+                hp_state = State::ChunkSize;
+            }
+            else if (hp_content_length > 0) {
+                hp_state = State::Body;
+            }
+            else {
+                hp_body = { hp_pos, 0 };
+                hp_state = State::Done;
+            }
+            break;
+
+        case State::Body:
+            if (len - hp_pos < hp_content_length) {
+                return ParseResult::Incomplete;
+            }
+            hp_body = { hp_pos, static_cast<int>(hp_content_length) };
+            hp_pos = hp_scan = hp_pos + hp_content_length;
+            hp_state = State::Done;
+            break;
+
+        case State::ChunkSize: {
+            if (!next_line(data, len, line)) {
+                return len - hp_pos > hp_max_header_size ? fail() : ParseResult::Incomplete;
+            }
+            long long size = 0;
+            int digits = 0;
+            for (int i = line.off; i < line.off + line.len && isxdigit(static_cast<unsigned char>(data[i])); i++) {
+                char c = data[i];
+                size = size * 16 + (isdigit(static_cast<unsigned char>(c)) ? c - '0' : (tolower(c) - 'a' + 10));
+                if (size > hp_max_body_size) {
+                    return fail();
+                }
+                digits++;
+            }
+            if (digits == 0 || size > hp_max_body_size - hp_chunk_total) {
+                return fail();
+            }
+            //长度之后只能是空白和以分号开始的扩展
+            int i = line.off + digits;
+            while (i < line.off + line.len && (data[i] == ' ' || data[i] == '\t')) i++;
+            if (i < line.off + line.len && data[i] != ';') {
+                return fail();
+            }
+            if (size == 0) {
+                hp_state = State::Trailers;
+            }
+            else {
+                hp_chunk_left = size;
+                hp_state = State::ChunkData;
+            }
+            break;
+        }
+
+        case State::ChunkData:
+            if (len - hp_pos < hp_chunk_left) {
+                return ParseResult::Incomplete;
+            }
+            hp_chunks.push_back({ hp_pos, static_cast<int>(hp_chunk_left) });
+            hp_chunk_total += hp_chunk_left;
+            hp_pos = hp_scan = hp_pos + hp_chunk_left;
+            hp_chunk_left = 0;
+            hp_state = State::ChunkDataEnd;
+            break;
+
+        case State::ChunkDataEnd:
+            if (!next_line(data, len, line)) {
+                return len - hp_pos > hp_max_header_size ? fail() : ParseResult::Incomplete;
+            }
+            if (line.len != 0) {
+                return fail();
+            }
+            hp_state = State::ChunkSize;
+            break;
+
+        case State::Trailers:
+            // trailer首部直接跳过
+            if (!next_line(data, len, line)) {
+                return len - hp_pos > hp_max_header_size ? fail() : ParseResult::Incomplete;
+            }
+            if (line.len == 0) {
+                hp_state = State::Done;
+            }
+            break;
+
+        case State::Done:
+            hp_consumed = hp_pos;
+            build_request(data);
+            return ParseResult::Complete;
+
+        case State::Error:
+            return ParseResult::Error;
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef __HTTP_PARSER_H__
+#define __HTTP_PARSER_H__
+
+#include <string_view>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+/// 一个完整的http请求，所有字段都是指向InputBuffer中数据的string_view，不做拷贝。
+/// 这些view只在对应的字节从InputBuffer中pop之前有效。
+struct HttpRequest
+{
+    string_view method;
+    string_view uri;
+    string_view version;
+    vector<pair<string_view, string_view>> headers;
+    string_view body;               ///Content-Length方式的请求体
+    vector<string_view> chunks;     ///chunked方式的请求体，每个数据块一个view
+    long long content_length{ 0 };  ///chunked方式时为各数据块长度之和
+    bool chunked{ false };
+    bool keep_alive{ true };
+
+    /// 按名字查找首部，不区分大小写，找不到返回空view
+    string_view get_header(string_view name) const;
+
+    void clear();
+};
+
+/// 可恢复的http/1.1请求解析器。
+/// 每次do_read之后用缓冲区中从请求起始处开始的全部数据调用parse，解析器记住已经扫描过的位置，
+/// 下次只扫描新到的字节。内部只保存相对于请求起始处的偏移，因此缓冲区扩容搬移数据后依然有效。
+class HttpParser
+{
+public:
+    enum class ParseResult { Incomplete, Complete, Error };
+
+    explicit HttpParser(int max_header_size = 8192, long long max_body_size = 8 * 1024 * 1024);
+
+    /// data指向当前请求的第一个字节，len为缓冲区中从data开始的可读字节数
+    ParseResult parse(const char *data, int len);
+
+    /// 解析完成后有效
+    const HttpRequest& request() const { return hp_request; }
+
+    /// 解析完成后，当前请求在缓冲区中占用的字节数
+    int consumed() const { return hp_consumed; }
+
+    /// 当前请求处理完并从缓冲区pop之后调用，开始解析下一个请求
+    void reset();
+
+private:
+    enum class State
+    {
+        RequestLine,
+        Headers,
+        Body,
+        ChunkSize,
+        ChunkData,
+        ChunkDataEnd,
+        Trailers,
+        Done,
+        Error,
+    };
+
+    struct Span
+    {
+        int off{ 0 };
+        int len{ 0 };
+    };
+
+    bool next_line(const char *data, int len, Span& line);
+    bool parse_request_line(const char *data, const Span& line);
+    bool parse_header_line(const char *data, const Span& line);
+    void build_request(const char *data);
+
+    ParseResult fail()
+    {
+        hp_state = State::Error;
+        return ParseResult::Error;
+    }
+
+    static string_view view(const char *data, const Span& s) { return string_view(data + s.off, s.len); }
+
+    State hp_state{ State::RequestLine };
+    int hp_pos{ 0 };                ///下一个待处理字节的偏移
+    int hp_scan{ 0 };               ///查找行结束符时已经扫描到的偏移，避免重复扫描
+    int hp_consumed{ 0 };
+    int hp_max_header_size;
+    long long hp_max_body_size;
+
+    Span hp_method;
+    Span hp_uri;
+    Span hp_version;
+    vector<pair<Span, Span>> hp_headers;
+    Span hp_body;
+    vector<Span> hp_chunks;
+    long long hp_chunk_left{ 0 };
+    long long hp_chunk_total{ 0 };  ///已经解析的数据块长度之和，不能超过请求体上限
+    long long hp_content_length{ -1 };
+    bool hp_chunked{ false };
+    bool hp_keep_alive{ true };
+
+    HttpRequest hp_request;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+#include "http_response.h"
+
+using namespace std;
+
+void HttpResponse::append_to(string& out, bool keep_alive) const
+{
+    append_head_to(out, keep_alive, hr_body.size());
+    out.append(hr_body);
+}
+
+void HttpResponse::append_head_to(string& out, bool keep_alive, size_t content_length) const
+{
+    char line[64];
+    int n = snprintf(line, sizeof line, "HTTP/1.1 %d ", hr_code);
+    out.append(line, n);
+    out.append(hr_reason);
+    out.append("\r\n");
+
+    for (auto& h : hr_headers) {
+        out.append(h.first);
+        out.append(": ");
+        out.append(h.second);
+        out.append("\r\n");
+    }
+
+    n = snprintf(line, sizeof line, "Content-Length: %zu\r\n", content_length);
+    out.append(line, n);
+    out.append(keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+}
+
+void HttpResponse::clear()
+{
+    hr_code = 200;
+    hr_reason = "OK";
+    hr_headers.clear();
+    hr_body.clear();
+    hr_file.clear();
+    hr_shared_body.reset();
+    hr_close = false;
+}
@@ -0,0 +1,51 @@
+#ifndef __HTTP_RESPONSE_H__
+#define __HTTP_RESPONSE_H__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+
+#include "../memory/shared_buf.h"
+
+using namespace std;
+
+class HttpResponse
+{
+public:
+    void set_status(int code, string_view reason) { hr_code = code; hr_reason = reason; }
+    int get_status() const { return hr_code; }
+
+    void add_header(string_view name, string_view value) { hr_headers.emplace_back(name, value); }
+    void set_body(string_view body) { hr_body = body; }
+    /// 共享的响应体，http server只格式化首部，响应体由writev直接从共享缓冲区发送，不拷贝
+    void set_body(const SharedBufSP& body) { hr_shared_body = body; }
+    const SharedBufSP& get_shared_body() const { return hr_shared_body; }
+    void set_content_type(string_view type) { add_header("Content-Type", type); }
+
+    /// 响应体是一个文件，http server通过文件缓存打开后用sendfile发送，文件不存在时回复404
+    void set_file(string_view path) { hr_file = path; }
+    const string& get_file() const { return hr_file; }
+
+    /// 处理完这个请求之后关闭连接
+    void set_close(bool close) { hr_close = close; }
+    bool is_close() const { return hr_close; }
+
+    /// 按http/1.1格式序列化追加到out中，自动加上Content-Length和Connection首部
+    void append_to(string& out, bool keep_alive) const;
+    /// 只追加状态行和首部，响应体长度由调用者给出
+    void append_head_to(string& out, bool keep_alive, size_t content_length) const;
+
+    void clear();
+
+private:
+    int hr_code{ 200 };
+    string hr_reason{ "OK" };
+    vector<pair<string, string>> hr_headers;
+    string hr_body;
+    string hr_file;
+    SharedBufSP hr_shared_body;
+    bool hr_close{ false };
+};
+
+#endif
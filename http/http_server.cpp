@@ -0,0 +1,121 @@
+#include <any>
+#include <string>
+
+#include "http_server.h"
+#include "../net/event_loop.h"
+#include "../memory/mem_pool.h"
+#include "../log/log.h"
+
+using namespace std;
+
+//一个请求要合并到一个chunk中解析，请求体的上限是最大的chunk减去首部的上限
+static const int MAX_HEADER_SIZE = 8192;
+static const long long MAX_BODY_SIZE = mUp - MAX_HEADER_SIZE;
+
+HttpServer::HttpServer(EventLoop* loop, const char *ip, uint16_t port, PollerType poller)
+    : hs_server(loop, ip, port, poller)
+{
+    hs_server.set_message_cb([this](const TcpConnSP& conn, InputBuffer* ibuf){ this->on_message(conn, ibuf); });
+}
+
+void HttpServer::on_message(const TcpConnSP& conn, InputBuffer* ibuf)
+{
+    //已经决定关闭的连接，后续到达的数据直接丢弃
+    if (conn->is_closing()) {
+        ibuf->clear();
+        return;
+    }
+
+    any *context = conn->get_context();
+    if (!context->has_value()) {
+        context->emplace<HttpParser>(MAX_HEADER_SIZE, MAX_BODY_SIZE);
+    }
+    HttpParser *parser = any_cast<HttpParser>(context);
+
+    //同一个loop线程中的连接依次处理，复用响应对象和发送缓冲
+    thread_local HttpResponse response;
+    thread_local string out;
+    out.clear();
+
+    while (ibuf->length() > 0) {
+        //请求跨多个chunk时get_from_buf会合并，最多合并一个最大的chunk，合并失败按错误请求处理
+        int len = min(ibuf->length(), static_cast<int>(mUp));
+        const char *data = ibuf->get_from_buf(len);
+        auto ret = data != nullptr ? parser->parse(data, len) : HttpParser::ParseResult::Error;
+        if (ret == HttpParser::ParseResult::Incomplete) {
+            if (len == ibuf->length()) {
+                break;
+            }
+            //一个chunk中放不下的请求（比如很长的chunked请求体）
+            ret = HttpParser::ParseResult::Error;
+        }
+
+        if (ret == HttpParser::ParseResult::Error) {
+            LOG_WARN("bad http request, conn fd is %d\n", conn->get_fd());
+            //错误页面只生成一次，所有连接共享
+            static const SharedBufSP bad_request = [](){
+                HttpResponse resp;
+                resp.set_status(400, "Bad Request");
+                string page;
+                resp.append_to(page, false);
+                return make_shared_buf(move(page));
+            }();
+            conn->send(out.data(), out.size());
+            conn->send(bad_request);
+            ibuf->clear();
+            parser->reset();
+            conn->close_after_write();
+            return;
+        }
+
+        const HttpRequest& request = parser->request();
+        response.clear();
+        if (hs_http_cb) {
+            hs_http_cb(request, &response);
+        }
+        else {
+            response.set_status(404, "Not Found");
+        }
+
+        bool keep_alive = request.keep_alive && !response.is_close();
+        OpenFileSP file;
+        if (!response.get_file().empty()) {
+            file = conn->getLoop()->get_file_cache().get(response.get_file());
+            if (!file) {
+                response.clear();
+                response.set_status(404, "Not Found");
+            }
+        }
+        if (file) {
+            //之前拼接的响应和这个响应的首部先写入输出缓冲区，文件内容随后用sendfile发送
+            response.append_head_to(out, keep_alive, file->of_size);
+            conn->send(out.data(), out.size());
+            conn->send_file(file, 0, file->of_size);
+            out.clear();
+        }
+        else if (const SharedBufSP& body = response.get_shared_body(); body) {
+            response.append_head_to(out, keep_alive, body->size());
+            conn->send(out.data(), out.size());
+            conn->send(body);
+            out.clear();
+        }
+        else {
+            response.append_to(out, keep_alive);
+        }
+
+        //请求处理完才能pop，request中的view指向这部分数据
+        ibuf->pop(parser->consumed());
+        parser->reset();
+
+        if (!keep_alive) {
+            ibuf->clear();
+            conn->send(out.data(), out.size());
+            conn->close_after_write();
+            return;
+        }
+    }
+
+    if (!out.empty()) {
+        conn->send(out.data(), out.size());
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef __HTTP_SERVER_H__
+#define __HTTP_SERVER_H__
+
+#include <functional>
+
+#include "../net/tcp_server.h"
+#include "http_parser.h"
+#include "http_response.h"
+
+using namespace std;
+
+class EventLoop;
+
+/// 在TcpServer之上的http/1.1服务器，支持keep-alive和流水线请求。
+/// 每个连接在context中保存一个HttpParser，一次读事件中到达的多个请求按顺序解析和处理，
+/// 所有响应先拼接起来，在消息回调结束后由TcpConnection一次发送。
+class HttpServer
+{
+public:
+    typedef function<void(const HttpRequest&, HttpResponse*)> HttpCallback;
+
+    HttpServer(EventLoop* loop, const char *ip, uint16_t port, PollerType poller = PollerType::Epoll);
+
+    ~HttpServer() {}
+
+    void set_http_cb(const HttpCallback& cb) { hs_http_cb = cb; }
+    void set_thread_num(int t_num) { hs_server.set_thread_num(t_num); }
+    void set_tcp_conn_timeout_ms(int ms) { hs_server.set_tcp_conn_timeout_ms(ms); }
+
+    TcpServer* get_tcp_server() { return &hs_server; }
+
+    void start() { hs_server.start(); }
+
+private:
+    void on_message(const TcpConnSP& conn, InputBuffer* ibuf);
+
+    TcpServer hs_server;
+    HttpCallback hs_http_cb;
+};
+
+#endif
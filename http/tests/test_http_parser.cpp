@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string>
+
+#include "../http_parser.h"
+#include "../../log/pr.h"
+
+using namespace std;
+
+typedef HttpParser::ParseResult Result;
+
+void test_simple_get()
+{
+    HttpParser parser;
+    string req = "GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: */*\r\n\r\n";
+
+    assert(parser.parse(req.data(), req.size()) == Result::Complete);
+    const HttpRequest& r = parser.request();
+    assert(r.method == "GET");
+    assert(r.uri == "/index.html");
+    assert(r.version == "HTTP/1.1");
+    assert(r.headers.size() == 2);
+    assert(r.get_header("host") == "127.0.0.1");
+    assert(r.get_header("ACCEPT") == "*/*");
+    assert(r.get_header("Cookie").empty());
+    assert(r.keep_alive);
+    assert(r.body.empty());
+    assert(parser.consumed() == (int)req.size());
+    // 返回的view指向原始数据，没有拷贝
+    assert(r.uri.data() == req.data() + 4);
+
+    PR_INFO("simple get test passed!\n");
+}
+
+/// 每次只多给一个字节，模拟多次do_read
+void test_byte_by_byte()
+{
+    HttpParser parser;
+    string req = "POST /form HTTP/1.1\r\nContent-Length: 11\r\nConnection: close\r\n\r\nhello world";
+
+    for (size_t i = 1; i < req.size(); i++) {
+        assert(parser.parse(req.data(), i) == Result::Incomplete);
+    }
+    assert(parser.parse(req.data(), req.size()) == Result::Complete);
+    assert(parser.request().body == "hello world");
+    assert(parser.request().content_length == 11);
+    assert(!parser.request().keep_alive);
+
+    PR_INFO("byte by byte test passed!\n");
+}
+
+/// 缓冲区扩容后数据被搬到新地址，之前的解析结果依然有效
+void test_relocated_buffer()
+{
+    HttpParser parser;
+    string req = "GET / HTTP/1.0\r\nUser-Agent: test\r\nConnection: keep-alive\r\n\r\n";
+
+    string first = req.substr(0, 20);
+    assert(parser.parse(first.data(), first.size()) == Result::Incomplete);
+
+    string moved = req;
+    assert(parser.parse(moved.data(), moved.size()) == Result::Complete);
+    assert(parser.request().method.data() == moved.data());
+    assert(parser.request().get_header("User-Agent") == "test");
+    assert(parser.request().keep_alive);
+
+    PR_INFO("relocated buffer test passed!\n");
+}
+
+void test_chunked()
+{
+    HttpParser parser;
+    string req = "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                 "5\r\nhello\r\n"
+                 "6;ext=1\r\n world\r\n"
+                 "0\r\nTrailer: x\r\n\r\n";
+
+    for (size_t i = 1; i < req.size(); i++) {
+        assert(parser.parse(req.data(), i) == Result::Incomplete);
+    }
+    assert(parser.parse(req.data(), req.size()) == Result::Complete);
+    const HttpRequest& r = parser.request();
+    assert(r.chunked);
+    assert(r.chunks.size() == 2);
+    assert(r.chunks[0] == "hello");
+    assert(r.chunks[1] == " world");
+    assert(r.content_length == 11);
+    assert(parser.consumed() == (int)req.size());
+
+    PR_INFO("chunked body test passed!\n");
+}
+
+void test_pipelined()
+{
+    HttpParser parser;
+    string reqs = "GET /a HTTP/1.1\r\n\r\n"
+                  "POST /b HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+                  "GET /c HTTP/1.1\r\n\r\n";
+
+    const char *data = reqs.data();
+    int left = reqs.size();
+    string uris;
+    while (left > 0) {
+        assert(parser.parse(data, left) == Result::Complete);
+        uris.append(parser.request().uri);
+        data += parser.consumed();
+        left -= parser.consumed();
+        parser.reset();
+    }
+    assert(uris == "/a/b/c");
+
+    PR_INFO("pipelined requests test passed!\n");
+}
+
+void test_errors()
+{
+    HttpParser parser;
+    string bad_line = "GARBAGE\r\n\r\n";
+    assert(parser.parse(bad_line.data(), bad_line.size()) == Result::Error);
+
+    parser.reset();
+    string bad_version = "GET / SPDY/3\r\n\r\n";
+    assert(parser.parse(bad_version.data(), bad_version.size()) == Result::Error);
+
+    parser.reset();
+    string bad_cl = "POST / HTTP/1.1\r\nContent-Length: 12a\r\n\r\n";
+    assert(parser.parse(bad_cl.data(), bad_cl.size()) == Result::Error);
+
+    parser.reset();
+    string two_cl = "POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nabcd";
+    assert(parser.parse(two_cl.data(), two_cl.size()) == Result::Error);
+
+    parser.reset();
+    string same_cl = "POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc";
+    assert(parser.parse(same_cl.data(), same_cl.size()) == Result::Complete);
+
+    parser.reset();
+    string bad_size = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5xyz\r\nhello\r\n0\r\n\r\n";
+    assert(parser.parse(bad_size.data(), bad_size.size()) == Result::Error);
+
+    parser.reset();
+    string ext = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5;name=v\r\nhello\r\n0\r\n\r\n";
+    assert(parser.parse(ext.data(), ext.size()) == Result::Complete);
+
+    //数据块之后的行也有长度上限
+    HttpParser short_line(64);
+    string long_end = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello" + string(100, 'x');
+    assert(short_line.parse(long_end.data(), long_end.size()) == Result::Error);
+
+    //每个数据块都不超过上限，总长度超过
+    HttpParser limited(8192, 10);
+    string big_chunked = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "6\r\nhello \r\n6\r\nworld!\r\n0\r\n\r\n";
+    assert(limited.parse(big_chunked.data(), big_chunked.size()) == Result::Error);
+
+    HttpParser small(64);
+    string big = "GET / HTTP/1.1\r\nX-Long: " + string(100, 'x');
+    assert(small.parse(big.data(), big.size()) == Result::Error);
+
+    PR_INFO("error handling test passed!\n");
+}
+
+int main()
+{
+    test_simple_get();
+    test_byte_by_byte();
+    test_relocated_buffer();
+    test_chunked();
+    test_pipelined();
+    test_errors();
+
+    PR_INFO("http parser test passed!\n");
+    return 0;
+}
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include "http_server.h"
+#include "event_loop.h"
+#include "log.h"
+#include "pr.h"
+
+using namespace std;
+
+const char *g_ip = "127.0.0.1";
+const uint16_t g_port = 8890;
+const char *g_file_dir = "/tmp";
+
+// 用法: http_server_test [uring]，加uring参数时服务器使用io_uring后端
+
+int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    inet_aton(g_ip, &addr.sin_addr);
+
+    for (int i = 0; i < 50; i++) {
+        if (connect(fd, (sockaddr*)&addr, sizeof addr) == 0) {
+            return fd;
+        }
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    assert(false);
+    return -1;
+}
+
+void write_all(int fd, const string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+        assert(n > 0);
+        sent += n;
+    }
+}
+
+/// 读到expect_len个字节或者对端关闭为止
+string read_n(int fd, size_t expect_len)
+{
+    string got;
+    char buf[4096];
+    while (got.size() < expect_len) {
+        ssize_t n = read(fd, buf, sizeof buf);
+        if (n <= 0) {
+            break;
+        }
+        got.append(buf, n);
+    }
+    return got;
+}
+
+string expect_response(const string& body, bool keep_alive)
+{
+    HttpResponse resp;
+    resp.set_body(body);
+    string out;
+    resp.append_to(out, keep_alive);
+    return out;
+}
+
+void test_pipelined(int fd)
+{
+    string reqs = "GET /first HTTP/1.1\r\nHost: test\r\n\r\n"
+                  "POST /second HTTP/1.1\r\nContent-Length: 4\r\n\r\nbody"
+                  "GET /third HTTP/1.1\r\n\r\n";
+    string expect = expect_response("/first", true) + expect_response("/second:body", true)
+                    + expect_response("/third", true);
+
+    write_all(fd, reqs);
+    string got = read_n(fd, expect.size());
+    assert(got == expect);
+
+    PR_INFO("pipelined requests answered in order!\n");
+}
+
+/// 一个请求被拆成多次发送
+void test_split_request(int fd)
+{
+    string req = "GET /split HTTP/1.1\r\nHost: test\r\n\r\n";
+    string expect = expect_response("/split", true);
+
+    write_all(fd, req.substr(0, 10));
+    this_thread::sleep_for(chrono::milliseconds(50));
+    write_all(fd, req.substr(10));
+    string got = read_n(fd, expect.size());
+    assert(got == expect);
+
+    PR_INFO("split request answered!\n");
+}
+
+void test_connection_close(int fd)
+{
+    string req = "GET /bye HTTP/1.1\r\nConnection: close\r\n\r\n";
+    string expect = expect_response("/bye", false);
+
+    write_all(fd, req);
+    string got = read_n(fd, expect.size() + 1);
+    assert(got == expect);
+
+    PR_INFO("connection closed after response!\n");
+}
+
+/// 文件响应和普通响应混在流水线中，文件内容由sendfile发送，顺序不变
+void test_send_file(int fd)
+{
+    string content;
+    for (int i = 0; i < 2 * 1024 * 1024; i++) {
+        content.push_back('a' + i % 26);
+    }
+    string path = string(g_file_dir) + "/http_server_test_file";
+    FILE *fp = fopen(path.c_str(), "wb");
+    assert(fp != nullptr);
+    fwrite(content.data(), 1, content.size(), fp);
+    fclose(fp);
+
+    HttpResponse head;
+    string file_resp;
+    head.append_head_to(file_resp, true, content.size());
+    file_resp += content;
+    HttpResponse not_found;
+    not_found.set_status(404, "Not Found");
+    string not_found_resp;
+    not_found.append_to(not_found_resp, true);
+
+    string reqs = "GET /before HTTP/1.1\r\n\r\n"
+                  "GET /file/http_server_test_file HTTP/1.1\r\n\r\n"
+                  "GET /after HTTP/1.1\r\n\r\n"
+                  "GET /file/http_server_test_missing HTTP/1.1\r\n\r\n";
+    string expect = expect_response("/before", true) + file_resp + expect_response("/after", true) + not_found_resp;
+    //第二次命中打开文件缓存
+    for (int i = 0; i < 2; i++) {
+        write_all(fd, reqs);
+        string got = read_n(fd, expect.size());
+        assert(got == expect);
+    }
+    unlink(path.c_str());
+
+    PR_INFO("file responses sent in order!\n");
+}
+
+/// 接近4M的请求体分多次到达，合并后一次解析完成
+void test_large_body(int fd)
+{
+    string body(4 * 1024 * 1024 - 8192, 'b');
+    string req = "POST /big HTTP/1.1\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+    string expect = expect_response("/big:" + body, true);
+
+    write_all(fd, req);
+    string got = read_n(fd, expect.size());
+    assert(got == expect);
+
+    PR_INFO("large body answered!\n");
+}
+
+/// 超过4M的请求体放不进一个chunk，解析首部时就按错误请求处理并关闭连接
+void test_body_too_large()
+{
+    int fd = connect_server();
+    string req = "POST /huge HTTP/1.1\r\nContent-Length: " + to_string(5 * 1024 * 1024) + "\r\n\r\n";
+    HttpResponse bad;
+    bad.set_status(400, "Bad Request");
+    string expect;
+    bad.append_to(expect, false);
+
+    write_all(fd, req);
+    string got = read_n(fd, expect.size() + 1);
+    assert(got == expect);
+    close(fd);
+
+    PR_INFO("too large body rejected!\n");
+}
+
+/// 空闲连接由所属loop的时间轮关闭
+void test_idle_timeout()
+{
+    int fd = connect_server();
+    auto t1 = chrono::steady_clock::now();
+    char c;
+    assert(read(fd, &c, 1) == 0);
+    auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - t1).count();
+    assert(ms >= 250);
+    close(fd);
+
+    PR_INFO("idle connection closed after %lld ms!\n", (long long)ms);
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+
+    PollerType type = argc > 1 && strcmp(argv[1], "uring") == 0 ? PollerType::IoUring : PollerType::Epoll;
+    EventLoop base_loop(type);
+    HttpServer server(&base_loop, g_ip, g_port, type);
+    server.set_http_cb([](const HttpRequest& req, HttpResponse* resp) {
+        if (req.uri.substr(0, 6) == "/file/") {
+            resp->set_file(string(g_file_dir) + string(req.uri.substr(5)));
+            return;
+        }
+        string body(req.uri);
+        if (!req.body.empty()) {
+            body.append(":");
+            body.append(req.body);
+        }
+        resp->set_body(body);
+    });
+    server.set_thread_num(2);
+    server.set_tcp_conn_timeout_ms(300);
+    server.start();
+    thread base_thread([&base_loop](){ base_loop.loop(); });
+
+    int fd = connect_server();
+    test_pipelined(fd);
+    assert(server.get_tcp_server()->conn_count() == 1);
+    test_split_request(fd);
+    test_send_file(fd);
+    test_large_body(fd);
+    test_connection_close(fd);
+    close(fd);
+    this_thread::sleep_for(chrono::milliseconds(50));
+    assert(server.get_tcp_server()->conn_count() == 0);
+    test_body_too_large();
+    test_idle_timeout();
+
+    base_loop.quit();
+    base_thread.join();
+
+    PR_INFO("http server test passed!\n");
+    return 0;
+}
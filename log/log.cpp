@@ -3,12 +3,68 @@
 #include <chrono>
 #include <stdarg.h>
 #include <stdexcept>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <spawn.h>
+#include <algorithm>
+
 #include "log.h"
 
 using namespace std;
 
 Logger::log_level g_log_level = Logger::LOG_LEVEL_INFO;
 
+/// 写日志线程没有记录时最多等待的时间，生产者只在队列过半时唤醒它
+static const int ASYNC_WAIT_MS = 10;
+/// 写日志线程格式化缓冲区的大小，攒满后交给输出缓冲区
+static const int ASYNC_WRITE_SIZE = 64 * 1024;
+/// 输出缓冲区的大小，写满一个换下一个
+static const int LOG_BUFFER_SIZE = 64 * 1024;
+/// 等待写入的缓冲区达到这么多个时，追加日志的线程等待写完，磁盘很慢时内存不会无限增长
+static const size_t MAX_FULL_BUFFERS = 64;
+/// 保留的空闲缓冲区个数
+static const size_t MAX_FREE_BUFFERS = 4;
+/// 一次writev最多写出的缓冲区个数
+static const int MAX_WRITE_IOV = 64;
+/// 压缩线程的io优先级，见ioprio_set(2)
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_CLASS_IDLE = 3;
+static const int IOPRIO_CLASS_SHIFT = 13;
+
+/// 输出缓冲区。next_file不为空时是换文件的标记，没有数据，写到这里时切换到这个文件
+struct Logger::LogBuffer
+{
+    unique_ptr<char[]> data;
+    int len = 0;
+    string next_file;
+
+    LogBuffer() : data(new char[LOG_BUFFER_SIZE]) {}
+    explicit LogBuffer(const string& file) : next_file(file) {}
+};
+
+/// 线程退出时标记本线程的环形队列，写日志线程读空后释放
+struct Logger::RingCloser
+{
+    LogRing *ring = nullptr;
+
+    ~RingCloser()
+    {
+        if (ring != nullptr)
+        {
+            Logger::l_thread_ring = nullptr;
+            ring->lr_closed.store(true, memory_order_release);
+        }
+    }
+};
+
 const char* LogLevelName[Logger::NUM_LOG_LEVELS] =
 {
   "[ERROR]",
@@ -26,6 +82,30 @@ struct my_time
     char minute;
     char second; 
 };
+/// 每个线程缓存当前这一秒格式化好的"年-月-日 时:分:秒"，秒数变化时才调用localtime_r重新格式化
+struct TimeCache
+{
+    time_t sec = -1;
+    my_time tm;
+    char str[72];   ///按6个int都取最长的情况留空间，编译器能确认不会截断
+};
+
+static const TimeCache& cached_time(time_t sec)
+{
+    thread_local TimeCache cache;
+    if (cache.sec != sec)
+    {
+        struct tm t;
+        localtime_r(&sec, &t);
+        cache.sec = sec;
+        cache.tm = { t.tm_year + 1900, static_cast<char>(t.tm_mon + 1), static_cast<char>(t.tm_mday),
+                static_cast<char>(t.tm_hour), static_cast<char>(t.tm_min), static_cast<char>(t.tm_sec) };
+        snprintf(cache.str, sizeof cache.str, "%04d-%02d-%02d %02d:%02d:%02d", t.tm_year + 1900, t.tm_mon + 1,
+                t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    }
+    return cache;
+}
+
 /// 获取当前系统时间，格式为年月日时分秒
 static my_time get_current_sys_time()
 {
@@ -44,36 +124,83 @@ Logger::Logger()
 
 Logger::~Logger()
 {
-    if(l_asyncw_thread)
+    is_thread_stop = true;
+    for (thread *t : { l_asyncw_thread, l_flush_thread })
     {
-        is_thread_stop = true;
-        if(l_asyncw_thread->joinable())
+        if (t == nullptr)
         {
-            l_buffer_queue->notify();
-            l_asyncw_thread->join();
+            continue;
         }
-        delete l_asyncw_thread;
+        if(t->joinable())
+        {
+            l_cond.notify_all();
+            t->join();
+        }
+        delete t;
     }
 
-    lock_guard<mutex> lck (l_mutex);
-    if (l_fp != NULL)
     {
-        fclose(l_fp);
+        unique_lock<mutex> lck (l_mutex);
+        if (l_cur)
+        {
+            retire_cur();
+            flush_pending(lck, l_policy.sync_interval_ms > 0);
+        }
+    }
+    if (l_fd >= 0 && !l_is_stdout)
+    {
+        close(l_fd);
+    }
+    close_retired_files();
+    if (l_spare_fd >= 0)
+    {
+        close(l_spare_fd);
+        unlink(l_spare_path.c_str());
     }
 
-    if(l_buf)
+    ///正在压缩的文件压缩完再退出，排队的文件不再压缩
+    if (l_compress_thread)
     {
-        delete [] l_buf;
+        {
+            lock_guard<mutex> lck (l_compress_mutex);
+            l_compress_stop = true;
+        }
+        l_compress_cond.notify_one();
+        l_compress_thread->join();
+        delete l_compress_thread;
     }
 
-    if(l_buffer_queue)
+    if(l_wbuf)
     {
-        delete l_buffer_queue;
+        delete [] l_wbuf;
     }
 }
+
+bool Logger::set_flush_policy(const FlushPolicy& policy)
+{
+    if (l_inited)
+    {
+        PR_WARN("flush policy must be set before init!\n");
+        return false;
+    }
+    l_policy = policy;
+    l_policy_set = true;
+    return true;
+}
+
+bool Logger::set_rotate_policy(const RotatePolicy& policy)
+{
+    if (l_inited)
+    {
+        PR_WARN("rotate policy must be set before init!\n");
+        return false;
+    }
+    l_rotate = policy;
+    return true;
+}
 ///
 /// \param file_name  dir/ dir / file, 作为 log output ,默认为stdout
-/// \param buffer_queue_size 默认为0，表示同步输出，大于0表示异步输出
+/// \param buffer_queue_size 默认为0，表示同步输出，大于0表示异步输出，为每个线程环形队列的记录个数
 /// \param level 默认为INFO
 /// \param buffer_size 默认为 1024*8
 /// \param split_lines  默认为5000
@@ -100,28 +227,25 @@ Logger::~Logger()
     }
 
     set_log_level(level);
-    ///如果buffer_queue_size大于0，则表示异步输出
-    if (buffer_queue_size >= 1)
-    {
-        l_is_async = true;
-         ///创建一个buffer_queue对象，用于存储日志信息
-        l_buffer_queue = new buffer_queue<string>(buffer_queue_size);
-        ///创建一个线程，用于异步输出日志
-        l_asyncw_thread = new thread(&Logger::async_flush);
-    }
     
     l_buf_size = buffer_size;
-    l_buf = new char[l_buf_size];
-    memset(l_buf, '\0', l_buf_size);
     l_split_lines = split_lines;
+    l_cur = make_unique<LogBuffer>();
+    l_last_flush = l_last_sync = chrono::steady_clock::now();
 
     my_time tm = get_current_sys_time();
     l_today = tm.day;
     /// 如果file_name为空，则使用stdout作为输出 
     if(l_is_stdout)
     {
+        l_fd = STDOUT_FILENO;
+        ///输出到屏幕时默认每行都立即写出
+        if (!l_policy_set)
+        {
+            l_policy.flush_level = LOG_LEVEL_DEBUG;
+        }
+        start_threads(buffer_queue_size);
         l_inited = true;
-        l_fp = stdout;
         PR_DEBUG("succeed in using stdout as log output\n");
         PR_DEBUG("log init finished!\n");
         return true;
@@ -145,15 +269,29 @@ Logger::~Logger()
         /// 则 l_dir_name为"C:/logs/"，
         /// l_file_name为"error.log"，则结果字符串将会是：
         /// C:/logs/2023_06_29_error.log
-        l_fp = fopen(log_file_fullname, "a");
+        l_fd = open_log_file(log_file_fullname);
     }
 
-    if (l_fp == NULL)
+    if (l_fd < 0)
     {
         PR_ERROR("open %s failed!\n", log_file_fullname);
         return false;
     }
+    ///重启后追加到当天已有的文件时，从已有的大小开始计算
+    struct stat st;
+    if (fstat(l_fd, &st) == 0)
+    {
+        l_file_bytes = st.st_size;
+    }
+    l_path = log_file_fullname;
+    l_spare_path = string(l_dir_name) + "." + l_file_name + ".next";
+    manage_files();
+    if (l_rotate.compress)
+    {
+        l_compress_thread = new thread([this] { compress_loop(); });
+    }
 
+    start_threads(buffer_queue_size);
     l_inited = true;
     PR_DEBUG("succeed in using file %s as log output\n", log_file_fullname);
     PR_DEBUG("log init finished!\n");
@@ -161,76 +299,561 @@ Logger::~Logger()
     return true;
 }
 
-void Logger::write_log(const char* file_name, const char* tn_callbackname, int line_no, log_level level, const char *format, ...)
+/// 日志文件已经打开，异步模式创建写日志线程，同步模式创建定时写入的线程
+void Logger::start_threads(int ring_size)
+{
+    if (ring_size < 1)
+    {
+        l_flush_thread = new thread([this] { flush_loop(); });
+        return;
+    }
+    l_is_async = true;
+    l_ring_size = 2;
+    while (l_ring_size < static_cast<size_t>(ring_size))
+    {
+        l_ring_size <<= 1;
+    }
+    ///一条日志最长l_buf_size，缓冲区剩余空间不够一条时先写出
+    l_wbuf_size = ASYNC_WRITE_SIZE + l_buf_size;
+    l_wbuf = new char[l_wbuf_size];
+    l_asyncw_thread = new thread(&Logger::async_flush);
+}
+
+int Logger::open_log_file(const char *path)
+{
+    return open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+bool Logger::need_rotate(int day) const
 {
-    my_time my_tm = get_current_sys_time();
+    ///输出到stdout时不换文件
+    ///如果当前时间不是当天、当前文件的行数达到了split_lines或者大小达到了max_bytes，则换一个新的日志文件
+    return !l_is_stdout && (l_today != day || l_count >= l_split_lines
+                            || (l_rotate.max_bytes > 0 && l_file_bytes >= l_rotate.max_bytes));
+}
 
+void Logger::rotate(int year, int month, int day)
+{
+    PR_DEBUG("start to create a new log file\n");
+    char new_file_name[301] = {0};
+    char prefix[24] = {0};
+
+    snprintf(prefix, 23, "%04d_%02d_%02d_", year, month, day);
+
+    if (l_today != day)
     {
-        lock_guard<mutex> lck (l_mutex);
-        l_count++;
-        ///如果当前时间不是当天或者写入的行数达到了split_lines，则创建一个新的日志文件
-        if (l_today != my_tm.day || l_count % l_split_lines == 0)
-        {
-            PR_DEBUG("start to create a new log file\n");
-            char new_file_name[301] = {0};
-            fflush(l_fp);
-            fclose(l_fp);
-            char prefix[24] = {0};
-        
-            snprintf(prefix, 23, "%04d_%02d_%02d_", my_tm.year, my_tm.month, my_tm.day);
-        
-            if (l_today != my_tm.day)
+        snprintf(new_file_name, 300, "%s%s%s", l_dir_name, prefix, l_file_name);
+        l_today = day;
+        l_file_index = 0;
+    }
+    else
+    {
+        snprintf(new_file_name, 300, "%s%s%s.%d", l_dir_name, prefix, l_file_name, ++l_file_index);
+    }
+    l_count = 0;
+    l_file_bytes = 0;
+
+    ///只在待写队列中放一个换文件的标记，不在锁中打开和关闭文件。
+    ///写文件的线程写完旧文件的数据后，在锁外切换到新文件
+    retire_cur();
+    l_full.push_back(make_unique<LogBuffer>(string(new_file_name)));
+}
+
+/// 后台线程关闭换下来的文件，并提前打开一个临时文件，换文件时改名为新文件的名字，不用在换文件时创建文件
+void Logger::manage_files()
+{
+    if (l_is_stdout)
+    {
+        return;
+    }
+    close_retired_files();
+    {
+        lock_guard<mutex> lck (l_spare_mutex);
+        if (l_spare_fd >= 0)
+        {
+            return;
+        }
+    }
+    ///不用O_TRUNC，ext4截断过的文件在close时会同步刷回
+    unlink(l_spare_path.c_str());
+    int fd = open(l_spare_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+    lock_guard<mutex> lck (l_spare_mutex);
+    l_spare_fd = fd;
+}
+
+void Logger::close_retired_files()
+{
+    vector<pair<int, string>> files;
+    {
+        lock_guard<mutex> lck (l_spare_mutex);
+        files.swap(l_retired_files);
+    }
+    for (auto& [fd, path] : files)
+    {
+        if (l_policy.sync_interval_ms > 0)
+        {
+            fdatasync(fd);
+        }
+        close(fd);
+        if (l_compress_thread)
+        {
+            {
+                lock_guard<mutex> lck (l_compress_mutex);
+                l_compress_files.push_back(move(path));
+            }
+            l_compress_cond.notify_one();
+        }
+    }
+}
+
+/// 写文件的线程写到换文件的标记时调用，只改名或者打开新文件，关闭旧文件交给后台线程。
+/// 新文件已经存在时（比如重启后）打开它追加，不覆盖
+void Logger::switch_file(const string& path)
+{
+    int fd = -1;
+    {
+        lock_guard<mutex> lck (l_spare_mutex);
+        if (l_fd >= 0)
+        {
+            l_retired_files.emplace_back(l_fd, l_path);
+        }
+        if (l_spare_fd >= 0)
+        {
+            if (renameat2(AT_FDCWD, l_spare_path.c_str(), AT_FDCWD, path.c_str(), RENAME_NOREPLACE) == 0)
             {
-                snprintf(new_file_name, 300, "%s%s%s", l_dir_name, prefix, l_file_name);
-                l_today = my_tm.day;
-                l_count = 0;
+                fd = l_spare_fd;
+                l_spare_fd = -1;
             }
-            else
+            else if (errno != EEXIST)
             {
-                snprintf(new_file_name, 300, "%s%s%s.%lld", l_dir_name, prefix, l_file_name, l_count / l_split_lines);
+                ///临时文件不能用了，重新打开一个
+                close(l_spare_fd);
+                l_spare_fd = -1;
             }
-            l_fp = fopen(new_file_name, "a");
         }
     }
+    if (fd < 0)
+    {
+        fd = open_log_file(path.c_str());
+    }
+    if (fd < 0)
+    {
+        PR_ERROR("open %s failed!\n", path.c_str());
+    }
+    l_fd = fd;
+    l_path = path;
+}
+
+void Logger::compress_loop()
+{
+    ///压缩线程使用最低的cpu和io优先级，gzip进程继承这个优先级
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
 
+    unique_lock<mutex> lck (l_compress_mutex);
+    while (true)
+    {
+        l_compress_cond.wait(lck, [this] { return l_compress_stop || !l_compress_files.empty(); });
+        if (l_compress_stop)
+        {
+            return;
+        }
+        string path = move(l_compress_files.front());
+        l_compress_files.pop_front();
+        lck.unlock();
+        compress_file(path);
+        lck.lock();
+    }
+}
+
+/// 调用gzip压缩换下来的日志文件，压缩后删除原文件
+void Logger::compress_file(const string& path)
+{
+    const char *argv[] = { "gzip", "-f", path.c_str(), nullptr };
+    pid_t pid;
+    int err = posix_spawnp(&pid, "gzip", nullptr, nullptr, const_cast<char**>(argv), environ);
+    if (err != 0)
+    {
+        PR_WARN("spawn gzip for %s failed, error is %d\n", path.c_str(), err);
+        return;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    {
+    }
+}
+
+void Logger::write_log(const char* file_name, const char* tn_callbackname, int line_no, log_level level, const char *format, ...)
+{
     va_list valst;///允许函数接收和处理数量不定的参数
     va_start(valst, format);
 
-    string log_str;
+    ///异步模式下格式化成字符串再按一个字符串参数写入环形队列，过长时截断
+    if (l_is_async)
     {
-        lock_guard<mutex> lck (l_mutex);
-        /// 将日志信息写入缓冲区  ，格式为：年-月-日 时:分:秒 日志等级 [文件名:函数名:行号] 日志信息
-        int n = snprintf(l_buf, 300, "%04d-%02d-%02d %02d:%02d:%02d %s [%s:%s:%d] ",
-                        my_tm.year, my_tm.month, my_tm.day,
-                            my_tm.hour, my_tm.minute, my_tm.second, LogLevelName[level],
-                            file_name, tn_callbackname, line_no);
-        
-        int m = vsnprintf(l_buf + n, l_buf_size - 1, format, valst);
-        l_buf[n + m] = '\n';
-        l_buf[n + m + 1] = '\0';
-        log_str = l_buf;
+        char body[sizeof(LogRecord::args)];
+        vsnprintf(body, sizeof body, format, valst);
+        va_end(valst);
+        log(file_name, tn_callbackname, line_no, level, "%s", static_cast<const char*>(body));
+        return;
     }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    const TimeCache& now = cached_time(ts.tv_sec);
+
+    /// 在本线程的缓冲区中格式化，格式为：年-月-日 时:分:秒 日志等级 [文件名:函数名:行号] 日志信息，最后留一个字节给换行
+    thread_local vector<char> line;
+    line.resize(l_buf_size);
+    int space = l_buf_size - 1;
+    int n = snprintf(line.data(), space, "%s %s [%s:%s:%d] ", now.str, LogLevelName[level],
+                        file_name, tn_callbackname, line_no);
+    n = min(max(n, 0), space - 1);
+    int m = vsnprintf(line.data() + n, space - n, format, valst);
+    m = min(max(m, 0), space - n - 1);
+    line[n + m] = '\n';
     va_end(valst);
-    
-    /// 如果是异步输出，则将日志信息写入buffer_queue中
+
+    /// 同步输出，加一次锁追加到输出缓冲区，是否写入文件由刷盘策略决定
+    unique_lock<mutex> lck (l_mutex);
+    if (need_rotate(now.tm.day))
+    {
+        rotate(now.tm.year, now.tm.month, now.tm.day);
+    }
+    l_count++;
+    l_file_bytes += n + m + 1;
+    append(lck, line.data(), n + m + 1, level <= l_policy.flush_level);
+}
+/// flush函数用于将缓冲区的内容写入文件
+void Logger::flush(void)
+{
     if (l_is_async)
     {
-        while (!l_buffer_queue->push(log_str) && !is_thread_stop)   //FIXME: use tm_condvar replacing busy loop
-        {               
-             ///busy loop
-        }
-        
+        l_cond.notify_all();
+    }
+    unique_lock<mutex> lck (l_mutex);
+    if (l_cur)
+    {
+        retire_cur();
+        flush_pending(lck, false);
+    }
+}
+
+void Logger::retire_cur()
+{
+    if (l_cur->len == 0)
+    {
+        return;
+    }
+    l_full.push_back(move(l_cur));
+    if (!l_free.empty())
+    {
+        l_cur = move(l_free.back());
+        l_free.pop_back();
     }
-    /// 如果是同步输出，则直接将日志信息写入文件 
     else
     {
+        l_cur = make_unique<LogBuffer>();
+    }
+}
+
+void Logger::append(unique_lock<mutex>& lck, const char *data, int len, bool urgent)
+{
+    ///磁盘跟不上时等写日志的线程写完一批
+    while (l_flushing && l_full.size() >= MAX_FULL_BUFFERS)
+    {
+        l_flushed_cond.wait(lck);
+    }
+    while (len > 0)
+    {
+        if (l_cur->len == LOG_BUFFER_SIZE)
+        {
+            retire_cur();
+        }
+        int n = min(len, LOG_BUFFER_SIZE - l_cur->len);
+        memcpy(l_cur->data.get() + l_cur->len, data, n);
+        l_cur->len += n;
+        l_pending += n;
+        data += n;
+        len -= n;
+    }
+    if (urgent || l_pending >= l_policy.flush_bytes)
+    {
+        retire_cur();
+        flush_pending(lck, false);
+    }
+}
+
+/// 组提交：第一个需要写文件的线程负责把所有排队的缓冲区写出，写的时候不持有l_mutex，
+/// 其他线程继续追加日志，它们换下来的缓冲区也由这个线程在下一轮写出，不用各自再写一次
+void Logger::flush_pending(unique_lock<mutex>& lck, bool sync)
+{
+    if (l_flushing)
+    {
+        l_sync_pending = l_sync_pending || sync;
+        return;
+    }
+    l_flushing = true;
+    vector<unique_ptr<LogBuffer>> batch;
+    while (!l_full.empty())
+    {
+        batch.swap(l_full);
+        l_pending = l_cur->len;
+        lck.unlock();
+        write_buffers(batch);
+        lck.lock();
+        for (auto& buf : batch)
+        {
+            if (buf->data && l_free.size() < MAX_FREE_BUFFERS)
+            {
+                buf->len = 0;
+                l_free.push_back(move(buf));
+            }
+        }
+        batch.clear();
+        l_unsynced = true;
+        l_last_flush = chrono::steady_clock::now();
+        l_flushed_cond.notify_all();
+    }
+    if ((sync || l_sync_pending) && l_unsynced && l_fd >= 0)
+    {
+        ///l_fd只由写文件的线程修改
+        int fd = l_fd;
+        l_sync_pending = false;
+        l_unsynced = false;
+        lck.unlock();
+        fdatasync(fd);
+        lck.lock();
+        l_last_sync = chrono::steady_clock::now();
+    }
+    l_flushing = false;
+}
+
+/// 按顺序写出一批缓冲区，两个换文件标记之间的连续缓冲区用一次writev写出
+void Logger::write_buffers(vector<unique_ptr<LogBuffer>>& batch)
+{
+    struct iovec vec[MAX_WRITE_IOV];
+    size_t i = 0;
+    while (i < batch.size())
+    {
+        if (!batch[i]->next_file.empty())
+        {
+            switch_file(batch[i]->next_file);
+            i++;
+            continue;
+        }
+        int fd = l_fd;
+        int cnt = 0;
+        while (i < batch.size() && cnt < MAX_WRITE_IOV && batch[i]->next_file.empty())
+        {
+            vec[cnt].iov_base = batch[i]->data.get();
+            vec[cnt].iov_len = batch[i]->len;
+            cnt++;
+            i++;
+        }
+        if (fd < 0)
+        {
+            continue;
+        }
+        if (fd == STDOUT_FILENO)
+        {
+            ///先写出stdout中已经printf的内容，保持和PR_*输出的先后顺序
+            fflush(stdout);
+        }
+        struct iovec *v = vec;
+        while (cnt > 0)
+        {
+            ssize_t n = writev(fd, v, cnt);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n < 0)
+            {
+                PR_ERROR("write log failed, errno is %d\n", errno);
+                break;
+            }
+            while (cnt > 0 && static_cast<size_t>(n) >= v->iov_len)
+            {
+                n -= v->iov_len;
+                v++;
+                cnt--;
+            }
+            if (cnt > 0)
+            {
+                v->iov_base = static_cast<char*>(v->iov_base) + n;
+                v->iov_len -= n;
+            }
+        }
+    }
+}
+
+void Logger::flush_if_due()
+{
+    manage_files();
+    auto now = chrono::steady_clock::now();
+    unique_lock<mutex> lck (l_mutex);
+    bool flush_due = l_pending > 0 && now - l_last_flush >= chrono::milliseconds(l_policy.flush_interval_ms);
+    bool sync_due = l_policy.sync_interval_ms > 0 && now - l_last_sync >= chrono::milliseconds(l_policy.sync_interval_ms);
+    if (flush_due || (sync_due && (l_unsynced || l_pending > 0)))
+    {
+        retire_cur();
+        flush_pending(lck, sync_due);
+    }
+}
+
+int Logger::flush_wait_ms() const
+{
+    int ms = l_policy.flush_interval_ms;
+    if (l_policy.sync_interval_ms > 0)
+    {
+        ms = min(ms, l_policy.sync_interval_ms);
+    }
+    return max(ms, 1);
+}
+
+void Logger::flush_loop()
+{
+    while (!is_thread_stop)
+    {
+        {
+            unique_lock<mutex> lck (l_cond_mutex);
+            l_cond.wait_for(lck, chrono::milliseconds(flush_wait_ms()));
+        }
+        flush_if_due();
+    }
+}
+
+LogRing *Logger::new_thread_ring()
+{
+    static thread_local RingCloser closer;
+    auto ring = make_unique<LogRing>(l_ring_size);
+    LogRing *p = ring.get();
+    {
+        lock_guard<mutex> lck (l_rings_mutex);
+        l_rings.push_back(move(ring));
+    }
+    closer.ring = p;
+    l_thread_ring = p;
+    return p;
+}
+
+LogRecord *Logger::wait_ring_space(LogRing *ring)
+{
+    LogRecord *rec;
+    while ((rec = ring->claim()) == nullptr)
+    {
+        if (is_thread_stop)
+        {
+            return nullptr;
+        }
+        l_cond.notify_one();
+        this_thread::yield();
+    }
+    return rec;
+}
+
+void Logger::async_write()
+{
+    while (true)
+    {
+        ///先读停止标志再读队列，析构之前写入的记录都会写出
+        bool stop = is_thread_stop;
+        {
+            lock_guard<mutex> lck (l_rings_mutex);
+            l_drain_rings.clear();
+            for (auto& ring : l_rings)
+            {
+                l_drain_rings.push_back(ring.get());
+            }
+        }
+
+        int cnt = 0;
+        for (LogRing *ring : l_drain_rings)
+        {
+            ///每个队列一轮最多读一圈，不让一个线程一直占着写日志线程
+            LogRecord *rec;
+            for (size_t i = 0; i < ring->capacity() && (rec = ring->front()) != nullptr; i++)
+            {
+                write_record(*rec);
+                ring->pop();
+                cnt++;
+            }
+        }
+        write_out();
+        flush_if_due();
+        if (cnt > 0)
+        {
+            continue;
+        }
+
+        ///线程已经退出并且读空的队列可以释放了
+        {
+            lock_guard<mutex> lck (l_rings_mutex);
+            l_rings.erase(remove_if(l_rings.begin(), l_rings.end(), [](const unique_ptr<LogRing>& ring) {
+                return ring->lr_closed.load(memory_order_acquire) && ring->front() == nullptr;
+            }), l_rings.end());
+        }
+        if (stop)
+        {
+            break;
+        }
+        unique_lock<mutex> lck (l_cond_mutex);
+        l_cond.wait_for(lck, chrono::milliseconds(min(ASYNC_WAIT_MS, flush_wait_ms())));
+    }
+}
+
+void Logger::write_record(const LogRecord& rec)
+{
+    const TimeCache& now = cached_time(rec.time_ns / 1000000000);
+    if (need_rotate(now.tm.day))
+    {
+        write_out();
         lock_guard<mutex> lck (l_mutex);
-        fputs(log_str.c_str(), l_fp);   
+        rotate(now.tm.year, now.tm.month, now.tm.day);
     }
+    l_count++;
+    if (l_wbuf_size - l_wlen < l_buf_size)
+    {
+        write_out();
+    }
+    l_wurgent = l_wurgent || rec.level <= l_policy.flush_level;
+
+    /// 格式和同步模式相同：年-月-日 时:分:秒 日志等级 [文件名:函数名:行号] 日志信息，最后留一个字节给换行
+    char *out = l_wbuf + l_wlen;
+    int space = l_buf_size - 1;
+    int n = snprintf(out, space, "%s %s [%s:%s:%d] ", now.str, LogLevelName[rec.level], rec.file, rec.func, rec.line);
+    n = min(max(n, 0), space - 1);
+    int m = rec.format(out + n, space - n, rec);
+    m = min(max(m, 0), space - n - 1);
+    out[n + m] = '\n';
+    l_wlen += n + m + 1;
+    l_file_bytes += n + m + 1;
 }
-/// flush函数用于将缓冲区的内容写入文件
-void Logger::flush(void)
+
+void Logger::write_out()
+{
+    if (l_wlen == 0)
+    {
+        return;
+    }
+    unique_lock<mutex> lck (l_mutex);
+    append(lck, l_wbuf, l_wlen, l_wurgent);
+    l_wlen = 0;
+    l_wurgent = false;
+}
+/// 绑定异步写日志线程的cpu，避免和io线程争抢同一个cpu
+bool Logger::set_thread_cpu(int cpu)
 {
-    lock_guard<mutex> lck (l_mutex);
-    fflush(l_fp);
+    if (l_asyncw_thread == nullptr || cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(l_asyncw_thread->native_handle(), sizeof set, &set) == 0;
 }
@@ -10,8 +10,14 @@
 #include <mutex>
 #include <assert.h>
 #include <atomic>
+#include <time.h>
+#include <vector>
+#include <memory>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
 
-#include "log_queue.h"
+#include "log_ring.h"
 #include "pr.h"
 
 using namespace std;
@@ -28,12 +34,28 @@ public:
         NUM_LOG_LEVELS,
     } log_level;
 
+    /// 刷盘策略：日志先追加到内存中的输出缓冲区，满足任意一个条件时把所有缓冲区用一次writev写入文件
+    struct FlushPolicy
+    {
+        int flush_bytes = 64 * 1024;                ///未写出的数据达到这么多字节
+        int flush_interval_ms = 1000;               ///距离上次写出超过这么多毫秒
+        log_level flush_level = LOG_LEVEL_ERROR;    ///这个等级及更严重的日志立即写出
+        int sync_interval_ms = 0;                   ///大于0时每隔这么多毫秒fdatasync一次，0表示交给内核
+    };
+
+    /// 换文件策略：除了按天和按行数换文件，还可以按文件大小换；换下来的文件可以在后台压缩
+    struct RotatePolicy
+    {
+        long long max_bytes = 0;                    ///文件达到这么多字节时换文件，0表示不按大小换
+        bool compress = false;                      ///换下来的文件由最低优先级的后台线程调用gzip压缩
+    };
+
     static Logger *get_instance()
     {
         static Logger instance;
         return &instance;
     }
-    ///异步写入，将缓冲区的内容写入文件
+    ///写日志线程的入口，格式化各线程环形队列中的记录并写入文件
     static void async_flush(void)
     {
         Logger::get_instance()->async_write();
@@ -44,9 +66,15 @@ public:
     static log_level set_log_level(log_level level);
 
     // this function is not reentrant, should be called at main thread before subthread started.
+    // buffer_queue_size大于0时为异步模式，表示每个写日志线程的环形队列的记录个数，向上取整为2的幂
     bool init(const char *file_name, int buffer_queue_size = 0, Logger::log_level = Logger::LOG_LEVEL_INFO,
                 int buffer_size = 8192, int split_lines = 5000);
 
+    ///设置刷盘策略，在init之前调用。不设置时输出到文件使用默认策略，输出到屏幕每行都立即写出
+    bool set_flush_policy(const FlushPolicy& policy);
+    ///设置换文件策略，在init之前调用
+    bool set_rotate_policy(const RotatePolicy& policy);
+
     bool is_inited()
     {
         return l_inited;
@@ -54,29 +82,64 @@ public:
 
     void write_log(const char* file_name, const char* tn_callbackname, int line_no, log_level level, const char *format, ...);
 
+    ///LOG_*宏调用。异步模式只把格式串指针和参数的原始字节写入本线程的环形队列，不加锁、不格式化，
+    ///由写日志线程格式化后批量写入；同步模式和write_log相同
+    template <typename... Args>
+    void log(const char* file_name, const char* tn_callbackname, int line_no, log_level level, const char *format, Args... args);
+
+    ///把输出缓冲区中的数据立即写入文件，异步模式同时唤醒写日志线程
     void flush(void);
 
+    ///把异步写日志线程绑定到cpu上，在init之后调用；同步模式没有写日志线程，返回false
+    bool set_thread_cpu(int cpu);
+
 private:
     Logger();
     Logger(const Logger&);
     ~Logger();
-    ///异步写入，将缓冲区的内容写入文件 由于是异步写入，所以不需要加锁
-    void *async_write()
-    {
-        string single_line;
-        //@ assuming that no thread pushes elements in, once async writing thread starts, it falls in sleep
-        //  and will never be awaken. To deal with that, an interface "notify" is introduced in buffer_queue.
-        //  In destruction func, notify is called to wake up this thread and let it stop naturally.
-        //@ assuming that pop func returns false under spurious wakeup, the loop will be over as well as the async writing thread,
-        //  which is not what we expected. So the variable is_thread_stop is introduced. Only in destruction func will it be setted,
-        //  combining with the notify func, the thread can finish normally. Anothor function of is_thread_stop is to terminate the
-        // busy loop of pushing operation in write_log func when this class comes to end.
-        while(l_buffer_queue->pop(single_line) && !is_thread_stop)
-        {
-            lock_guard<mutex> lck (l_mutex);
-            fputs(single_line.c_str(), l_fp); 
-        }   
-    }
+    struct LogBuffer;
+
+    ///异步模式下创建写日志线程，ring_size为每个线程环形队列的记录个数；同步模式创建按时间写出的线程
+    void start_threads(int ring_size);
+    ///写日志线程循环：轮流读空各线程的环形队列，格式化到l_wbuf中，攒满或读空后追加到输出缓冲区
+    void async_write();
+    ///格式化一条记录追加到l_wbuf中，需要时先换日志文件
+    void write_record(const LogRecord& rec);
+    ///把l_wbuf中的数据追加到输出缓冲区
+    void write_out();
+    ///同步模式的定时线程，按刷盘策略的时间间隔写出和fdatasync
+    void flush_loop();
+    int flush_wait_ms() const;
+    ///距离上次写出或fdatasync的时间到了时写出，在l_mutex之外调用
+    void flush_if_due();
+
+    ///以下函数在l_mutex中调用
+    ///当前日期不是l_today或者行数达到l_split_lines时需要换一个新的日志文件
+    bool need_rotate(int day) const;
+    ///在待写队列中放一个换文件的标记，旧文件的数据写完后才切换
+    void rotate(int year, int month, int day);
+    ///追加到当前输出缓冲区，urgent或者数据量达到flush_bytes时写出
+    void append(unique_lock<mutex>& lck, const char *data, int len, bool urgent);
+    ///把当前输出缓冲区移到待写队列
+    void retire_cur();
+    ///写出待写队列，写的时候释放锁；已经有线程在写时直接返回，由它一起写出
+    void flush_pending(unique_lock<mutex>& lck, bool sync);
+
+    ///以下函数由写文件的线程在l_mutex之外调用
+    void write_buffers(vector<unique_ptr<LogBuffer>>& batch);
+    ///切换到新文件，旧文件交给后台线程关闭
+    void switch_file(const string& path);
+
+    ///由后台线程调用，关闭换下来的文件交给压缩线程，提前打开下一个日志文件
+    void manage_files();
+    void close_retired_files();
+    void compress_loop();
+    static void compress_file(const string& path);
+    static int open_log_file(const char *path);
+    ///本线程第一次写异步日志时创建并注册环形队列
+    LogRing *new_thread_ring();
+    ///环形队列满时唤醒写日志线程并让出cpu，直到有空槽；Logger析构时返回nullptr，丢弃这条日志
+    LogRecord *wait_ring_space(LogRing *ring);
 
 private:
     char l_dir_name[128]; 
@@ -85,17 +148,94 @@ private:
     int l_buf_size;
     long long l_count;
     int l_today;       
-    FILE *l_fp;     
-    char *l_buf = nullptr;
+    int l_file_index = 0;       ///当天第几个文件，文件名的后缀
+    long long l_file_bytes = 0; ///当前文件写入的字节数
+    int l_fd = -1;              ///正在写的文件，只由写文件的线程修改
+    string l_path;
     bool l_inited = false;
-    buffer_queue<string> *l_buffer_queue = nullptr;
-    bool l_is_async; 
+    bool l_is_async = false;
     bool l_is_stdout = false;
     atomic<bool> is_thread_stop = false;
     mutex l_mutex;              // TODO: add mutexes for different critical resources
     thread *l_asyncw_thread = nullptr;
+    thread *l_flush_thread = nullptr;
+
+    FlushPolicy l_policy;
+    bool l_policy_set = false;
+    unique_ptr<LogBuffer> l_cur;                    ///正在追加的输出缓冲区
+    vector<unique_ptr<LogBuffer>> l_full;           ///等待写出的缓冲区，按顺序写出
+    vector<unique_ptr<LogBuffer>> l_free;
+    int l_pending = 0;                              ///还没有写出的字节数
+    bool l_flushing = false;                        ///有线程正在写文件
+    bool l_unsynced = false;                        ///上次fdatasync之后写过数据
+    bool l_sync_pending = false;
+    chrono::steady_clock::time_point l_last_flush;
+    chrono::steady_clock::time_point l_last_sync;
+    condition_variable l_flushed_cond;              ///待写的缓冲区太多时等待写完一批
+
+    RotatePolicy l_rotate;
+    mutex l_spare_mutex;                            ///保护l_spare_fd和l_retired_files
+    int l_spare_fd = -1;                            ///提前打开的临时文件
+    vector<pair<int, string>> l_retired_files;      ///换下来等待关闭的文件
+    string l_spare_path;
+    thread *l_compress_thread = nullptr;
+    mutex l_compress_mutex;
+    condition_variable l_compress_cond;
+    deque<string> l_compress_files;                 ///等待压缩的文件
+    bool l_compress_stop = false;
+
+    size_t l_ring_size = 0;
+    struct RingCloser;
+    static inline thread_local LogRing *l_thread_ring = nullptr;  ///本线程的环形队列
+    mutex l_rings_mutex;                            ///保护l_rings，只在线程注册和退出时竞争
+    vector<unique_ptr<LogRing>> l_rings;
+    vector<LogRing*> l_drain_rings;                 ///写日志线程每一轮读取的队列
+    mutex l_cond_mutex;
+    condition_variable l_cond;                      ///写日志线程没有记录时等待
+    char *l_wbuf = nullptr;                         ///写日志线程的批量写缓冲区
+    int l_wbuf_size = 0;
+    int l_wlen = 0;
+    bool l_wurgent = false;                         ///l_wbuf中有需要立即写出的日志
 };
 
+template <typename... Args>
+void Logger::log(const char* file_name, const char* tn_callbackname, int line_no, log_level level, const char *format, Args... args)
+{
+    if (!l_inited)
+    {
+        PR_ERROR("logger must be inited before user!\n");
+        return;
+    }
+    if (!l_is_async)
+    {
+        write_log(file_name, tn_callbackname, line_no, level, format, args...);
+        return;
+    }
+
+    LogRing *ring = l_thread_ring != nullptr ? l_thread_ring : new_thread_ring();
+    LogRecord *rec = ring->claim();
+    if (rec == nullptr && (rec = wait_ring_space(ring)) == nullptr)
+    {
+        return;
+    }
+    struct timespec ts;
+    ///只精确到秒，粗粒度时钟不需要读硬件计数器
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    rec->format = &log_arg::format<Args...>;
+    rec->fmt = format;
+    rec->file = file_name;
+    rec->func = tn_callbackname;
+    rec->time_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    rec->line = line_no;
+    rec->level = level;
+    log_arg::encode(rec->args, sizeof rec->args, args...);
+    ///需要立即写出的日志也马上唤醒写日志线程
+    if (ring->publish() || level <= l_policy.flush_level)
+    {
+        l_cond.notify_one();
+    }
+}
+
 
 extern Logger::log_level g_log_level;
 
@@ -112,60 +252,71 @@ inline Logger::log_level Logger::set_log_level(Logger::log_level level)
     return old_level;
 }
 
-#define LOG_DEBUG(format, ...)              \
-    do{                                    \
-        if(!Logger::get_instance()->is_inited())                       \
-        {                                                               \
-            PR_ERROR("logger must be inited before user!\n");           \
-        }                                                               \
-        if(Logger::LOG_LEVEL_DEBUG <= Logger::get_log_level())            \
-        {                                       \
-            Logger::get_instance()->write_log(__FILE__, __FUNCTION__,       \
-                __LINE__, Logger::LOG_LEVEL_DEBUG, format, ##__VA_ARGS__);   \
-            Logger::get_instance()->flush();                                \
+/// 编译进程序的最高日志等级，取值同Logger::log_level，默认全部编译。
+/// 例如编译时加-DLOG_COMPILE_LEVEL=2，LOG_DEBUG展开为空语句，参数不会求值，也不会检查运行时的日志等级
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 3
+#endif
+
+/// 被编译掉的日志语句仍然引用参数，避免只在日志中使用的变量产生未使用的警告，不会被调用
+inline void log_discard(const char *, ...) {}
+
+#define LOG_DISCARD(format, ...)                                            \
+    do{                                                                     \
+        if(false)                                                           \
+        {                                                                   \
+            log_discard(format, ##__VA_ARGS__);                             \
+        }                                                                   \
+    } while(0)
+
+/// 运行时只比较一次日志等级，是否已经init在log函数中检查
+#if LOG_COMPILE_LEVEL >= 3
+#define LOG_DEBUG(format, ...)                                              \
+    do{                                                                     \
+        if(Logger::LOG_LEVEL_DEBUG <= Logger::get_log_level())              \
+        {                                                                   \
+            Logger::get_instance()->log(__FILE__, __FUNCTION__,             \
+                __LINE__, Logger::LOG_LEVEL_DEBUG, format, ##__VA_ARGS__);  \
         }                                                                   \
     } while(0)
+#else
+#define LOG_DEBUG(format, ...) LOG_DISCARD(format, ##__VA_ARGS__)
+#endif
+
 /// LOG_INFO 是一个宏，用于输出日志信息，如果日志等级大于等于INFO，则输出日志信息
-/// write_log函数用于将日志信息写入缓冲区，flush函数用于将缓冲区的内容写入文件
-#define LOG_INFO(format, ...)               \
-    do{                                   \
-        if(!Logger::get_instance()->is_inited())                       \
-        {                                                               \
-            PR_ERROR("logger must be inited before user!\n");           \
-        }                                                               \
-        if(Logger::LOG_LEVEL_INFO <= Logger::get_log_level())             \
-        {                                   \
-            Logger::get_instance()->write_log(__FILE__, __FUNCTION__,       \
+/// log函数在同步模式下格式化后写入文件，异步模式下把参数写入本线程的环形队列
+#if LOG_COMPILE_LEVEL >= 2
+#define LOG_INFO(format, ...)                                               \
+    do{                                                                     \
+        if(Logger::LOG_LEVEL_INFO <= Logger::get_log_level())               \
+        {                                                                   \
+            Logger::get_instance()->log(__FILE__, __FUNCTION__,             \
                 __LINE__, Logger::LOG_LEVEL_INFO, format, ##__VA_ARGS__);   \
-            Logger::get_instance()->flush();                                \
-        }                                                                  \
+        }                                                                   \
     } while(0)
+#else
+#define LOG_INFO(format, ...) LOG_DISCARD(format, ##__VA_ARGS__)
+#endif
 
+#if LOG_COMPILE_LEVEL >= 1
 #define LOG_WARN(format, ...)                                               \
-    do{                                                                      \
-        if(!Logger::get_instance()->is_inited())                       \
-        {                                                               \
-            PR_ERROR("logger must be inited before user!\n");           \
-        }                                                               \
-        if(Logger::LOG_LEVEL_WARN <= Logger::get_log_level())              \
-        {                                                                    \
-            Logger::get_instance()->write_log(__FILE__, __FUNCTION__,       \
+    do{                                                                     \
+        if(Logger::LOG_LEVEL_WARN <= Logger::get_log_level())               \
+        {                                                                   \
+            Logger::get_instance()->log(__FILE__, __FUNCTION__,             \
                 __LINE__, Logger::LOG_LEVEL_WARN, format, ##__VA_ARGS__);   \
-            Logger::get_instance()->flush();                                  \
-        }                                                                     \
+        }                                                                   \
     } while(0)
+#else
+#define LOG_WARN(format, ...) LOG_DISCARD(format, ##__VA_ARGS__)
+#endif
 
 #define LOG_ERROR(format, ...)                                              \
-    do{                                                                      \
-        if(!Logger::get_instance()->is_inited())                       \
-        {                                                               \
-            PR_ERROR("logger must be inited before user!\n");           \
-        }                                                               \
-        if(Logger::LOG_LEVEL_ERROR <= Logger::get_log_level())             \
+    do{                                                                     \
+        if(Logger::LOG_LEVEL_ERROR <= Logger::get_log_level())              \
         {                                                                   \
-            Logger::get_instance()->write_log(__FILE__, __FUNCTION__,       \
-                __LINE__, Logger::LOG_LEVEL_ERROR, format, ##__VA_ARGS__);   \
-            Logger::get_instance()->flush();                                 \
+            Logger::get_instance()->log(__FILE__, __FUNCTION__,             \
+                __LINE__, Logger::LOG_LEVEL_ERROR, format, ##__VA_ARGS__);  \
         }                                                                   \
     } while(0)
 
@@ -7,17 +7,23 @@
 #include <chrono>
 #include <assert.h>
 #include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include "pr.h"
 
 using namespace std;
 
+/// 有界阻塞队列。右值入队和出队都是移动，pop_batch一次加锁取出多个元素；
+/// 生产者和消费者各用一个条件变量，只有对方有线程在等待时才notify
 template <class T>
 class buffer_queue
 {
 public:
-    buffer_queue() : b_array(new T[capacity])
+    buffer_queue()
     {
+        b_array = new T[capacity];
     }
 
     explicit buffer_queue(int max_size, bool debug=false)
@@ -121,86 +127,167 @@ public:
         value = b_array[b_last];
         return true;
     }
-    //入队
+    //入队，队列满时返回false
     bool push(const T &item)
     {
-        unique_lock<mutex> lck (b_mutex);;
-        if (b_size >= capacity)
-        {
-            b_cond.notify_all();            
-            return false;
-        }
+        return put(item, 0);
+    }
 
-        b_last = (b_last + 1) % capacity;
-        b_array[b_last] = item;
+    bool push(T &&item)
+    {
+        return put(move(item), 0);
+    }
+    //入队，队列满时最多等待ms_timeout毫秒，ms_timeout小于0时一直等到有空位
+    bool push(const T &item, int ms_timeout)
+    {
+        return put(item, ms_timeout);
+    }
 
-        b_size++;
-        if(b_debug)
-        {
-            b_wcnt++;
-        }
-        b_cond.notify_all();
-        
-        return true;
+    bool push(T &&item, int ms_timeout)
+    {
+        return put(move(item), ms_timeout);
     }
-    
+    //在锁外用参数构造元素，再移动入队，队列满时返回false
+    template <typename... Args>
+    bool emplace(Args&&... args)
+    {
+        return put(T(forward<Args>(args)...), 0);
+    }
+    //唤醒所有等待的消费者，仍然没有元素时它们返回false
     void notify()
     {
-        b_cond.notify_all();
+        b_not_empty.notify_all();
     }
-    //出队
+    //出队，队列为空时等待，被notify唤醒时仍为空返回false
     bool pop(T &item)
     {
-
+        return pop(item, -1);
+    }
+    //ms_timeout小于0时和pop(item)相同
+    bool pop(T &item, int ms_timeout)
+    {
         unique_lock<mutex> lck (b_mutex);
-        if (b_size <= 0)
-        {           
-            b_cond.wait(lck);
-            if(b_size <= 0) 
-            {
-                return false;
-            }
+        if (!wait_not_empty(lck, ms_timeout))
+        {
+            return false;
         }
 
         b_first = (b_first + 1) % capacity;
-        item = b_array[b_first];
+        item = move(b_array[b_first]);
         b_size--;
         if(b_debug)
         {
             b_rcnt++;
         }
-
-        return true;       
+        notify_producer(1);
+        return true;
     }
-
-    bool pop(T &item, int ms_timeout)
+    //一次加锁最多取出max_num个元素，追加到items后面，返回取出的个数。等待的方式同pop
+    int pop_batch(vector<T> &items, int max_num, int ms_timeout = -1)
     {
         unique_lock<mutex> lck (b_mutex);
-        if (b_size <= 0)
-        {           
-            if(b_cond.wait_for(lck, chrono::milliseconds(ms_timeout)) == cv_status::timeout)
-                return false;
+        if (max_num <= 0 || !wait_not_empty(lck, ms_timeout))
+        {
+            return 0;
+        }
+
+        int n = min(max_num, b_size);
+        for (int i = 0; i < n; i++)
+        {
+            b_first = (b_first + 1) % capacity;
+            items.push_back(move(b_array[b_first]));
         }
+        b_size -= n;
+        if(b_debug)
+        {
+            b_rcnt += n;
+        }
+        notify_producer(n);
+        return n;
+    }
 
-        if (b_size <= 0)
-        {            
+private:
+    //拷贝或移动赋值到槽中的元素，拷贝时可以复用槽中已有的内存
+    template <typename U>
+    bool put(U &&item, int ms_timeout)
+    {
+        unique_lock<mutex> lck (b_mutex);
+        if (!wait_not_full(lck, ms_timeout))
+        {
             return false;
         }
+        b_last = (b_last + 1) % capacity;
+        b_array[b_last] = forward<U>(item);
 
-        b_first = (b_first + 1) % capacity;
-        item = b_array[b_first];
-        b_size--;
+        b_size++;
         if(b_debug)
         {
-            b_rcnt++;
+            b_wcnt++;
+        }
+        //持有锁时唤醒。解锁后再唤醒的话，被唤醒的消费者马上抢到锁，每次只取走一个元素
+        if (b_pop_waiters > 0)
+        {
+            b_not_empty.notify_one();
         }
-        
         return true;
     }
 
-private:
+    //以下函数在b_mutex中调用
+    void notify_producer(int freed)
+    {
+        int waiting = b_push_waiters;
+        if (waiting == 1 || (waiting > 0 && freed == 1))
+        {
+            b_not_full.notify_one();
+        }
+        else if (waiting > 1)
+        {
+            b_not_full.notify_all();
+        }
+    }
+
+    //和原来一样只等待一次，被notify唤醒时可能仍然没有元素。ms_timeout为0时不等待
+    bool wait_not_empty(unique_lock<mutex> &lck, int ms_timeout)
+    {
+        if (b_size <= 0 && ms_timeout != 0)
+        {
+            b_pop_waiters++;
+            if (ms_timeout < 0)
+            {
+                b_not_empty.wait(lck);
+            }
+            else
+            {
+                b_not_empty.wait_for(lck, chrono::milliseconds(ms_timeout));
+            }
+            b_pop_waiters--;
+        }
+        return b_size > 0;
+    }
+
+    bool wait_not_full(unique_lock<mutex> &lck, int ms_timeout)
+    {
+        if (b_size >= capacity && ms_timeout != 0)
+        {
+            b_push_waiters++;
+            if (ms_timeout < 0)
+            {
+                b_not_full.wait(lck, [this] { return b_size < capacity; });
+            }
+            else
+            {
+                b_not_full.wait_for(lck, chrono::milliseconds(ms_timeout), [this] { return b_size < capacity; });
+            }
+            b_push_waiters--;
+        }
+        return b_size < capacity;
+    }
+
     mutable mutex b_mutex;
-    condition_variable b_cond;  
+    condition_variable b_not_empty;     //消费者等待有元素
+    condition_variable b_not_full;      //生产者等待有空位
+    int b_pop_waiters = 0;
+    int b_push_waiters = 0;
     T *b_array;
     long long b_rcnt = 0;
     long long b_wcnt = 0;
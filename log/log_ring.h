@@ -0,0 +1,194 @@
+#ifndef __LOG_RING_H__
+#define __LOG_RING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+
+using namespace std;
+
+struct LogRecord;
+/// 用记录中的格式串和参数格式化日志正文，返回值同snprintf
+typedef int (*LogFormatFn)(char *out, int size, const LogRecord& rec);
+
+/// 一条日志记录，定长，直接写在环形队列的槽中。
+/// 只保存格式串、文件名和函数名的指针（都是字面量）以及参数的原始字节，字符串参数复制到记录中，
+/// 格式化由写日志线程完成
+struct alignas(64) LogRecord {
+    static constexpr int RECORD_SIZE = 256;
+
+    LogFormatFn format;
+    const char *fmt;
+    const char *file;
+    const char *func;
+    int64_t time_ns;
+    int line;
+    int level;
+    char args[RECORD_SIZE - 48];
+};
+static_assert(sizeof(LogRecord) == LogRecord::RECORD_SIZE, "log record size");
+
+namespace log_arg {
+
+template <typename T>
+constexpr bool is_str = is_same_v<T, char*> || is_same_v<T, const char*>;
+
+/// 参数在记录中保存的类型，字符串保存内容，取出时是指向记录内部的指针
+template <typename T>
+using stored_t = conditional_t<is_str<T>, const char*, T>;
+
+/// 除字符串内容以外参数占用的字节数，字符串只计结尾的'\0'
+template <typename T>
+constexpr size_t fixed_size() {
+    if constexpr (is_str<T>) {
+        return 1;
+    }
+    else {
+        static_assert(is_trivially_copyable_v<T>, "log argument must be a printf argument");
+        return sizeof(T);
+    }
+}
+
+template <typename T>
+void put(char *&p, size_t& str_space, T v)
+{
+    if constexpr (is_str<T>) {
+        const char *s = v != nullptr ? v : "(null)";
+        size_t n = strnlen(s, str_space);
+        memcpy(p, s, n);
+        p[n] = '\0';
+        p += n + 1;
+        str_space -= n;
+    }
+    else {
+        memcpy(p, &v, sizeof v);
+        p += sizeof v;
+    }
+}
+
+template <typename T>
+stored_t<T> get(const char *&p)
+{
+    if constexpr (is_str<T>) {
+        const char *s = p;
+        p += strlen(s) + 1;
+        return s;
+    }
+    else {
+        T v;
+        memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        return v;
+    }
+}
+
+/// 通过va_list调用vsnprintf，格式串不是字面量时也不会产生格式警告
+inline int vformat(char *out, int size, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(out, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+/// 按参数类型顺序写入原始字节，字符串共享除定长参数以外的剩余空间，放不下时截断
+template <typename... Args>
+void encode(char *buf, size_t size, Args... args)
+{
+    constexpr size_t fixed = (size_t(0) + ... + fixed_size<Args>());
+    static_assert(fixed <= sizeof(LogRecord::args), "too many log arguments");
+    (void)size;
+    size_t str_space = size - fixed;
+    char *p = buf;
+    (put<Args>(p, str_space, args), ...);
+    //没有参数时上面的折叠表达式为空
+    (void)str_space;
+    (void)p;
+}
+
+/// 按同样的类型顺序取出参数再格式化，每种参数类型组合实例化一个
+template <typename... Args>
+int format(char *out, int size, const LogRecord& rec)
+{
+    const char *p = rec.args;
+    //花括号初始化保证从左到右取参数
+    tuple<stored_t<Args>...> values{ get<Args>(p)... };
+    (void)p;
+    return apply([&](auto... v) { return vformat(out, size, rec.fmt, v...); }, values);
+}
+
+}
+
+/// 单生产者单消费者的定长记录环形队列，每个写日志的线程一个，由写日志线程消费。
+/// 生产者和消费者各自缓存对方的位置，只有看起来满或空时才重新读取对方的原子变量
+class LogRing {
+public:
+    /// 槽在构造时清零，提前把内存页映射好，写日志时不会缺页
+    explicit LogRing(size_t capacity)
+        : lr_slots(new LogRecord[capacity]()), lr_mask(capacity - 1)
+    {
+        assert(capacity > 1 && (capacity & (capacity - 1)) == 0);
+    }
+
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    size_t capacity() const { return lr_mask + 1; }
+
+    /// 生产者调用，返回尾部的空槽，队列满时返回nullptr
+    LogRecord *claim() {
+        size_t tail = lr_tail.load(memory_order_relaxed);
+        if (tail - lr_head_cache > lr_mask) {
+            lr_head_cache = lr_head.load(memory_order_acquire);
+            if (tail - lr_head_cache > lr_mask) {
+                return nullptr;
+            }
+        }
+        return &lr_slots[tail & lr_mask];
+    }
+
+    /// 生产者调用，发布claim得到的槽。每发布半个队列的记录返回一次true，由调用者唤醒消费者
+    bool publish() {
+        size_t tail = lr_tail.load(memory_order_relaxed) + 1;
+        lr_tail.store(tail, memory_order_release);
+        return (tail & (lr_mask >> 1)) == 0;
+    }
+
+    /// 消费者调用，返回头部的记录，队列空时返回nullptr
+    LogRecord *front() {
+        size_t head = lr_head.load(memory_order_relaxed);
+        if (head == lr_tail_cache) {
+            lr_tail_cache = lr_tail.load(memory_order_acquire);
+            if (head == lr_tail_cache) {
+                return nullptr;
+            }
+        }
+        return &lr_slots[head & lr_mask];
+    }
+
+    /// 消费者调用，释放front返回的记录
+    void pop() {
+        lr_head.store(lr_head.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    /// 生产者线程退出时置位，消费者读空后释放队列
+    atomic<bool> lr_closed{ false };
+
+private:
+    unique_ptr<LogRecord[]> lr_slots;
+    size_t lr_mask;
+    alignas(64) atomic<size_t> lr_tail{ 0 };
+    size_t lr_head_cache{ 0 };      /// 生产者看到的消费位置
+    alignas(64) atomic<size_t> lr_head{ 0 };
+    size_t lr_tail_cache{ 0 };      /// 消费者看到的生产位置
+};
+
+#endif
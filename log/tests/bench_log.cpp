@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include "../log.h"
+#include "../pr.h"
+
+using namespace std;
+
+// 用法: bench_log [每个线程的行数] [线程数...]
+// 异步模式下多个线程同时写INFO日志（一个整数和一个字符串参数）。
+// burst: 每次连续写BURST_LINES行后停一会，让写日志线程追上，只统计写日志的线程上每次调用的平均耗时，也就是io线程写一行日志的代价；
+// sustained: 不停地写，统计所有线程合计每秒写入的行数，这时受写日志线程格式化和写文件的速度限制
+
+const int BURST_LINES = 2000;
+const int BURST_PAUSE_MS = 20;
+
+atomic<long long> g_total_ns{ 0 };
+
+void worker(int lines, bool burst)
+{
+    long long ns = 0;
+    for (int i = 0; i < lines; )
+    {
+        int n = burst ? min(BURST_LINES, lines - i) : lines;
+        auto t1 = chrono::steady_clock::now();
+        for (int j = 0; j < n; j++, i++)
+        {
+            LOG_INFO("bench log line %d from %s\n", i, "worker");
+        }
+        ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t1).count();
+        if (burst)
+        {
+            this_thread::sleep_for(chrono::milliseconds(BURST_PAUSE_MS));
+        }
+    }
+    g_total_ns += ns;
+}
+
+int main(int argc, char *argv[])
+{
+    int lines = argc > 1 ? atoi(argv[1]) : 200000;
+    vector<int> thread_nums;
+    for (int i = 2; i < argc; i++)
+    {
+        thread_nums.push_back(atoi(argv[i]));
+    }
+    if (thread_nums.empty())
+    {
+        thread_nums = { 1, 2, 4 };
+    }
+
+    //不按行数切分文件
+    Logger::get_instance()->init("./bench_log.txt", 8192, Logger::LOG_LEVEL_INFO, 8192, 1000000000);
+
+    for (int n : thread_nums)
+    {
+        for (bool burst : { true, false })
+        {
+            g_total_ns = 0;
+            auto t1 = chrono::steady_clock::now();
+            vector<thread> threads;
+            for (int i = 0; i < n; i++)
+            {
+                threads.emplace_back(worker, lines, burst);
+            }
+            for (auto& t : threads)
+            {
+                t.join();
+            }
+            double sec = chrono::duration<double>(chrono::steady_clock::now() - t1).count();
+            PR_INFO("threads %d, %-9s lines %lld, %.1f ns per call, %.2f M lines/s\n", n, burst ? "burst" : "sustained",
+                        (long long)n * lines, (double)g_total_ns / ((long long)n * lines), n * lines / sec / 1e6);
+        }
+    }
+    return 0;
+}
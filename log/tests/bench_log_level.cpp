@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+//本文件只编译INFO及以上等级的日志，LOG_DEBUG展开为空语句
+#undef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 2
+
+#include "../log.h"
+#include "../pr.h"
+
+using namespace std;
+
+// 用法: bench_log_level [每一项的调用次数]
+// 同步模式写文件，运行时日志等级为INFO，统计每一项每秒的调用次数：
+// ERROR/WARN/INFO正常写入；DEBUG在编译时被去掉；把运行时等级调到WARN后的INFO只比较一次等级；
+// write_log+flush是原来LOG_*宏每次调用走的路径
+
+typedef chrono::steady_clock Clock;
+
+template <typename F>
+void run(const char *name, int calls, F&& f)
+{
+    auto t1 = Clock::now();
+    for (int i = 0; i < calls; i++)
+    {
+        f(i);
+    }
+    double sec = chrono::duration<double>(Clock::now() - t1).count();
+    PR_INFO("%-20s %10.2f M calls/s, %8.1f ns per call\n", name, calls / sec / 1e6, sec * 1e9 / calls);
+}
+
+int main(int argc, char *argv[])
+{
+    int calls = argc > 1 ? atoi(argv[1]) : 200000;
+
+    //不按行数切分文件
+    Logger::get_instance()->init("./bench_log_level.txt", 0, Logger::LOG_LEVEL_INFO, 8192, 1000000000);
+
+    run("LOG_ERROR", calls, [](int i) { LOG_ERROR("bench log level %d from %s\n", i, "error"); });
+    run("LOG_WARN", calls, [](int i) { LOG_WARN("bench log level %d from %s\n", i, "warn"); });
+    run("LOG_INFO", calls, [](int i) { LOG_INFO("bench log level %d from %s\n", i, "info"); });
+    run("LOG_DEBUG compiled", calls, [](int i) { LOG_DEBUG("bench log level %d from %s\n", i, "debug"); });
+
+    Logger::set_log_level(Logger::LOG_LEVEL_WARN);
+    run("LOG_INFO runtime off", calls, [](int i) { LOG_INFO("bench log level %d from %s\n", i, "info"); });
+    Logger::set_log_level(Logger::LOG_LEVEL_INFO);
+
+    run("write_log+flush", calls, [](int i) {
+        Logger::get_instance()->write_log(__FILE__, __FUNCTION__, __LINE__, Logger::LOG_LEVEL_INFO,
+                    "bench log level %d from %s\n", i, "write_log");
+        Logger::get_instance()->flush();
+    });
+    return 0;
+}
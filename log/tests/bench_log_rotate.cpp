@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../log.h"
+#include "../pr.h"
+
+using namespace std;
+
+// 用法: bench_log_rotate [每个线程的行数] [每个文件的行数] [线程数]
+// 同步模式多个线程写日志，每个文件的行数很少，频繁换文件。
+// 统计每次调用的耗时分布，换文件时如果在锁中打开和关闭文件，所有写日志的线程都会出现长尾
+
+typedef chrono::steady_clock Clock;
+
+int main(int argc, char *argv[])
+{
+    int lines = argc > 1 ? atoi(argv[1]) : 50000;
+    int split_lines = argc > 2 ? atoi(argv[2]) : 1000;
+    int thread_num = argc > 3 ? atoi(argv[3]) : 4;
+
+    Logger::get_instance()->init("./bench_log_rotate.txt", 0, Logger::LOG_LEVEL_INFO, 8192, split_lines);
+
+    vector<vector<int>> costs(thread_num, vector<int>(lines));
+    vector<thread> threads;
+    auto t1 = Clock::now();
+    for (int t = 0; t < thread_num; t++)
+    {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < lines; i++)
+            {
+                auto start = Clock::now();
+                LOG_INFO("bench log rotate thread %d line %d", t, i);
+                costs[t][i] = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    double sec = chrono::duration<double>(Clock::now() - t1).count();
+
+    vector<int> all;
+    for (auto& c : costs)
+    {
+        all.insert(all.end(), c.begin(), c.end());
+    }
+    sort(all.begin(), all.end());
+    long long total = all.size();
+    PR_INFO("threads %d, lines %lld, files %lld, %.2f M lines/s\n", thread_num, total, total / split_lines,
+            total / sec / 1e6);
+    PR_INFO("per call: p50 %d ns, p99 %d ns, p99.9 %d ns, max %d ns\n", all[total / 2], all[total * 99 / 100],
+            all[total * 999 / 1000], all.back());
+    return 0;
+}
@@ -3,6 +3,9 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
 #include "../pr.h"
 #include "../log_queue.h"
 
@@ -74,6 +77,115 @@ void fill_q(buffer_queue<qType>& q, bool test=false)
     }  
 }
 
+//移动入队、满时等待和批量出队
+void test_move_batch()
+{
+    buffer_queue<string> q(4, true);
+    const string origin(100, 'a');
+    string s = origin;
+    bool ret = q.push(move(s));
+    assert(ret);
+    ret = q.emplace(3, 'b');
+    assert(ret);
+    ret = q.push(string("c"));
+    assert(ret);
+    ret = q.push(string("d"), 0);
+    assert(ret && q.is_full());
+
+    auto start = chrono::steady_clock::now();
+    ret = q.push(string("e"), 50);
+    assert(!ret && chrono::steady_clock::now() - start >= chrono::milliseconds(50));
+
+    vector<string> items;
+    int n = q.pop_batch(items, 3);
+    assert(n == 3 && items[0] == origin && items[1] == "bbb" && items[2] == "c");
+    n = q.pop_batch(items, 10, 0);
+    assert(n == 1 && items[3] == "d");
+    n = q.pop_batch(items, 10, 10);
+    assert(n == 0 && q.get_rcnt() == 4 && q.get_wcnt() == 4);
+
+    //生产者在满队列上等待，消费者取走一批后继续，顺序不变
+    const int num = 1000;
+    thread p([&q] {
+        for (int i = 0; i < num; i++)
+        {
+            bool ok = q.push(to_string(i), -1);
+            assert(ok);
+        }
+    });
+    items.clear();
+    while (static_cast<int>(items.size()) < num)
+    {
+        q.pop_batch(items, 3, 100);
+    }
+    p.join();
+    for (int i = 0; i < num; i++)
+    {
+        assert(items[i] == to_string(i));
+    }
+    PR_INFO("buffer queue move and batch test passed!\n");
+}
+
+//多个生产者一个消费者争用队列，生产者每次新建一行日志长度的string，统计每秒经过队列的元素个数。
+//copy: 原来的用法，拷贝入队，满时重试，一次出队一个；move+batch: 移动入队，满时等待，一次出队一批
+void bench_contended(bool batch, int p_num, int items)
+{
+    buffer_queue<string> q(1024);
+    const string line(120, 'x');
+    auto start = chrono::steady_clock::now();
+    vector<thread> producers;
+    for (int t = 0; t < p_num; t++)
+    {
+        producers.emplace_back([&] {
+            for (int i = 0; i < items; i++)
+            {
+                string s = line;
+                if (batch)
+                {
+                    q.push(move(s), -1);
+                }
+                else
+                {
+                    while (!q.push(s))
+                    {
+                        this_thread::yield();
+                    }
+                }
+            }
+        });
+    }
+
+    long long total = static_cast<long long>(p_num) * items;
+    long long got = 0;
+    size_t bytes = 0;
+    string item;
+    vector<string> out;
+    while (got < total)
+    {
+        if (batch)
+        {
+            out.clear();
+            got += q.pop_batch(out, 256, 10);
+            for (auto& s : out)
+            {
+                bytes += s.size();
+            }
+        }
+        else if (q.pop(item, 10))
+        {
+            got++;
+            bytes += item.size();
+        }
+    }
+    for (auto& t : producers)
+    {
+        t.join();
+    }
+    assert(bytes == total * line.size());
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    PR_INFO("%-10s producers %d, items %lld, %.2f M items/s\n", batch ? "move+batch" : "copy", p_num, total, total / sec / 1e6);
+}
+
 int main()
 {
     pr_set_level(PR_LEVEL_DEBUG);
@@ -142,5 +254,14 @@ int main()
     assert( g_q.get_wcnt() == ( g_size + p_n1 + p_n2 ) );
     PR_INFO("buffer queue mutithread test passed!\n");
 
+    test_move_batch();
+
+    pr_set_level(PR_LEVEL_INFO);
+    for (int p_num : { 1, 4 })
+    {
+        bench_contended(false, p_num, 200000);
+        bench_contended(true, p_num, 200000);
+    }
+
     return 0;
 }
\ No newline at end of file
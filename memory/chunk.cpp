@@ -9,9 +9,13 @@ Chunk::Chunk(int size) : capacity(size), data(new char[size])
     assert(data);
 }
 
+Chunk::Chunk(int size, char *buf, void *owner) : capacity(size), data(buf), slab(owner)
+{
+}
+
 Chunk::~Chunk()
 {
-    if( data )
+    if( data && slab == nullptr )
     {
         delete [] data;
     }
@@ -4,6 +4,8 @@
 struct Chunk{
 
     explicit Chunk(int size);
+    /// 数据在内存池的slab中，不由Chunk释放
+    Chunk(int size, char *buf, void *owner);
 
     ~Chunk();
 
@@ -24,6 +26,7 @@ struct Chunk{
     int head{ 0 };
     char *data{ nullptr };
     Chunk *next{ nullptr };
+    void *slab{ nullptr };  ///所属的slab，为空时data由Chunk自己申请
 };
 
 #endif
\ No newline at end of file
@@ -1,12 +1,21 @@
-#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <memory.h>
+#include <errno.h>
 #include <assert.h>
+#include <algorithm>
 
 #include "data_buf.h"
 #include "pr.h"
 
-BufferBase::BufferBase() 
+using namespace std;
+
+/// readv时栈上临时缓冲区的大小，尾部chunk放不下的数据先读到这里
+static const int EXTRA_BUF_SIZE = 64 * 1024;
+/// 追加chunk时单个chunk的最大规格，更大的数据用多个chunk
+static const int MAX_APPEND_CHUNK = m256K;
+
+BufferBase::BufferBase()
 {
 }
 
@@ -15,136 +24,286 @@ BufferBase::~BufferBase()
     clear();
 }
 
-const int BufferBase::length() const 
+const int BufferBase::length() const
 {
-    return data_buf != nullptr ? data_buf->length : 0;
+    return data_length;
 }
 
-void BufferBase::pop(int len) 
+void BufferBase::pop(int len)
 {
-    assert(data_buf != nullptr && len <= data_buf->length);
+    assert(len <= data_length);
 
-    data_buf->pop(len);
-    if(data_buf->length == 0) {
-        Mempool::get_instance().retrieve(data_buf);
-        data_buf = nullptr;
+    data_length -= len;
+    while (len > 0) {
+        Chunk *front = data_buf;
+        int n = min(len, front->length);
+        front->pop(n);
+        len -= n;
+        if (front->length == 0) {
+            data_buf = front->next;
+            Mempool::get_instance().retrieve(front);
+        }
+    }
+    /// 头部已经读完的chunk也释放
+    while (data_buf != nullptr && data_buf->length == 0) {
+        Chunk *front = data_buf;
+        data_buf = front->next;
+        Mempool::get_instance().retrieve(front);
+    }
+    if (data_buf == nullptr) {
+        data_tail = nullptr;
     }
 }
 
 void BufferBase::clear()
 {
-    if (data_buf != nullptr)  {
-        Mempool::get_instance().retrieve(data_buf);
-        data_buf = nullptr;
+    while (data_buf != nullptr) {
+        Chunk *front = data_buf;
+        data_buf = front->next;
+        Mempool::get_instance().retrieve(front);
     }
+    data_tail = nullptr;
+    data_length = 0;
 }
 
-/// 读取数据到缓冲区 ，返回读取的字节数
-int InputBuffer::read_from_fd(int fd)
+Chunk *BufferBase::append_chunk(int size)
 {
-    int need_read;
-    // FIONREAD: get readable bytes num in kernel buffer
-    /// 读取内核缓冲区中的可读字节数    
-    if (ioctl(fd, FIONREAD, &need_read) == -1) {
-        PR_ERROR("ioctl FIONREAD error\n");
-        return -1;
+    Chunk *chunk = Mempool::get_instance().alloc_chunk(size);
+    if (chunk == nullptr) {
+        PR_INFO("no free buf for alloc\n");
+        return nullptr;
     }
-    
-    if (data_buf == nullptr) {
-        data_buf = Mempool::get_instance().alloc_chunk(need_read);
-        if (data_buf == nullptr) {
-            PR_INFO("no free buf for alloc\n");
-            return -1;
-        }
+    if (data_tail == nullptr) {
+        data_buf = data_tail = chunk;
     }
     else {
-        assert(data_buf->head == 0);
-        /// 如果缓冲区剩余空间不足，重新分配
-        if (data_buf->capacity - data_buf->length < (int)need_read) {   
-            Chunk *new_buf = Mempool::get_instance().alloc_chunk(need_read + data_buf->length);
-            if (new_buf == nullptr) {
-                PR_INFO("no free buf for alloc\n");
+        data_tail->next = chunk;
+        data_tail = chunk;
+    }
+    return chunk;
+}
+
+int BufferBase::tail_space() const
+{
+    return data_tail != nullptr ? data_tail->capacity - data_tail->head - data_tail->length : 0;
+}
+
+int BufferBase::append(const char *data, int len)
+{
+    while (len > 0) {
+        int space = tail_space();
+        if (space == 0) {
+            if (append_chunk(min(len, MAX_APPEND_CHUNK)) == nullptr) {
                 return -1;
             }
-            new_buf->copy(data_buf);
-            Mempool::get_instance().retrieve(data_buf);
-            data_buf = new_buf;
+            continue;
         }
+        int n = min(space, len);
+        memcpy(data_tail->data + data_tail->head + data_tail->length, data, n);
+        data_tail->length += n;
+        data_length += n;
+        data += n;
+        len -= n;
     }
+    return 0;
+}
+
+/// 读取数据到缓冲区 ，返回读取的字节数
+int InputBuffer::read_from_fd(int fd, bool *drained)
+{
+    /// 内存池耗尽时按ENOMEM出错返回，调用者关闭连接
+    if (tail_space() == 0 && append_chunk(m4K) == nullptr) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /// 先填满尾部chunk，多出来的读到栈上，不需要提前知道内核中有多少数据
+    char extra_buf[EXTRA_BUF_SIZE];
+    int space = tail_space();
+    struct iovec vec[2];
+    vec[0].iov_base = data_tail->data + data_tail->head + data_tail->length;
+    vec[0].iov_len = space;
+    vec[1].iov_base = extra_buf;
+    vec[1].iov_len = sizeof extra_buf;
 
     int already_read = 0;
-    do { 
-        if(need_read == 0) {  ///need_read == 0，表示 ioctl 未能确定可读的字节数，或者没有数据可读
-            already_read = read(fd, data_buf->data + data_buf->length, m4K);
-        } else {
-            already_read = read(fd, data_buf->data + data_buf->length, need_read);
-        }
+    do {
+        already_read = readv(fd, vec, 2);
     } while (already_read == -1 && errno == EINTR);/// 读取数据时，被信号中断，重新读取
+    if (drained != nullptr) {
+        *drained = already_read >= 0 && already_read < space + EXTRA_BUF_SIZE;
+    }
     if (already_read > 0)  {    /// 读取成功，更新缓冲区长度
-        if (need_read != 0) {/// 需要读取的字节数不为0，已读取的字节数应该等于需要读取的字节数
-            assert(already_read == need_read);
+        int in_tail = min(already_read, space);
+        data_tail->length += in_tail;
+        data_length += in_tail;
+        if (already_read > in_tail && append(extra_buf, already_read - in_tail) != 0) {
+            errno = ENOMEM;
+            return -1;
         }
-        data_buf->length += already_read;
     }
 
     return already_read;
 }
-/// 获取缓冲区中的数据
-const char *InputBuffer::get_from_buf() const 
+void InputBuffer::take_chunk(Chunk *chunk)
 {
-    return data_buf != nullptr ? data_buf->data + data_buf->head : nullptr;
+    if (chunk->length <= tail_space()) {
+        memcpy(data_tail->data + data_tail->head + data_tail->length, chunk->data + chunk->head, chunk->length);
+        data_tail->length += chunk->length;
+        data_length += chunk->length;
+        Mempool::get_instance().retrieve(chunk);
+        return;
+    }
+    chunk->next = nullptr;
+    if (data_tail == nullptr) {
+        data_buf = data_tail = chunk;
+    }
+    else {
+        data_tail->next = chunk;
+        data_tail = chunk;
+    }
+    data_length += chunk->length;
 }
-
-void InputBuffer::adjust()
+/// 获取缓冲区开头的数据，只有这些数据跨chunk时才合并。
+/// 合并用的chunk按缓冲区长度的两倍申请，之后到达的数据直接写在合并后的数据后面，
+/// 数据逐次到达时不会每次都重新合并全部数据
+const char *InputBuffer::get_from_buf(int len)
 {
-    if (data_buf != nullptr) {
-        data_buf->adjust();
+    if (data_buf == nullptr || len > data_length) {
+        return nullptr;
     }
+    if (data_buf->length < len) {
+        int size = data_length < mUp / 2 ? data_length * 2 : mUp;
+        Chunk *merged = size >= len ? Mempool::get_instance().alloc_chunk(size) : nullptr;
+        if (merged == nullptr) {
+            PR_INFO("no free buf for merge %d bytes\n", len);
+            return nullptr;
+        }
+        //chunk放不下全部数据时，最后一个chunk只合并一部分，剩下的留在链表中
+        while (data_buf != nullptr && merged->length < merged->capacity) {
+            Chunk *front = data_buf;
+            int n = min(front->length, merged->capacity - merged->length);
+            memcpy(merged->data + merged->length, front->data + front->head, n);
+            merged->length += n;
+            if (n < front->length) {
+                front->pop(n);
+                break;
+            }
+            data_buf = front->next;
+            Mempool::get_instance().retrieve(front);
+        }
+        merged->next = data_buf;
+        if (data_buf == nullptr) {
+            data_tail = merged;
+        }
+        data_buf = merged;
+    }
+    return data_buf->data + data_buf->head;
+}
+
+void OutputBuffer::clear()
+{
+    BufferBase::clear();
+    ob_shared.clear();
+    ob_shared_len = 0;
+    ob_chunk_popped = 0;
 }
 
-/// 将数据写入缓冲区，返回写入的字节数
+/// 将数据写入缓冲区，成功返回0
 int OutputBuffer::write2buf(const char *data, int len)
 {
-    if (data_buf == nullptr) {
-        data_buf = Mempool::get_instance().alloc_chunk(len);
-        if (data_buf == nullptr) {
-            PR_INFO("no free buf for alloc\n");
-            return -1;
-        }
+    return append(data, len);
+}
+
+int OutputBuffer::write2buf(const SharedBufSP& buf)
+{
+    if (buf == nullptr || buf->size() == 0) {
+        return 0;
     }
-    else {
-        assert(data_buf->head == 0);
-        if (data_buf->capacity - data_buf->length < len) {
-            Chunk *new_buf = Mempool::get_instance().alloc_chunk(len + data_buf->length);
-            if (new_buf == nullptr) {
-                PR_INFO("no free buf for alloc\n");
-                return -1;
+    ob_shared.push_back(SharedSeg{ buf, 0, ob_chunk_popped + data_length });
+    ob_shared_len += buf->size();
+    return 0;
+}
+
+void OutputBuffer::consume(int len)
+{
+    while (len > 0) {
+        if (!ob_shared.empty() && ob_shared.front().chunk_pos == ob_chunk_popped) {
+            SharedSeg& seg = ob_shared.front();
+            int n = min(len, seg.buf->size() - seg.offset);
+            seg.offset += n;
+            ob_shared_len -= n;
+            len -= n;
+            if (seg.offset == seg.buf->size()) {
+                ob_shared.pop_front();
             }
-            new_buf->copy(data_buf);
-            Mempool::get_instance().retrieve(data_buf);
-            data_buf = new_buf;
+            continue;
         }
+        int n = min(len, data_length);
+        if (!ob_shared.empty()) {
+            n = min<uint64_t>(n, ob_shared.front().chunk_pos - ob_chunk_popped);
+        }
+        pop(n);
+        ob_chunk_popped += n;
+        len -= n;
     }
+}
 
-    memcpy(data_buf->data + data_buf->length, data, len);
-    data_buf->length += len;
-
-    return 0;
+/// 按写入顺序收集chunk和共享缓冲区，共享缓冲区可能插在一个chunk的中间
+int OutputBuffer::fill_iovec(struct iovec *vec, int max_cnt, int limit)
+{
+    if (limit < 0 || limit > length()) {
+        limit = length();
+    }
+    int cnt = 0;
+    Chunk *chunk = data_buf;
+    int chunk_off = 0;
+    uint64_t chunk_pos = ob_chunk_popped;
+    auto seg = ob_shared.begin();
+    while (limit > 0 && cnt < max_cnt) {
+        if (seg != ob_shared.end() && seg->chunk_pos == chunk_pos) {
+            int n = min(limit, seg->buf->size() - seg->offset);
+            vec[cnt].iov_base = const_cast<char*>(seg->buf->data() + seg->offset);
+            vec[cnt].iov_len = n;
+            cnt++;
+            limit -= n;
+            ++seg;
+            continue;
+        }
+        while (chunk != nullptr && chunk_off == chunk->length) {
+            chunk = chunk->next;
+            chunk_off = 0;
+        }
+        assert(chunk != nullptr);
+        int n = min(limit, chunk->length - chunk_off);
+        if (seg != ob_shared.end()) {
+            n = min<uint64_t>(n, seg->chunk_pos - chunk_pos);
+        }
+        vec[cnt].iov_base = chunk->data + chunk->head + chunk_off;
+        vec[cnt].iov_len = n;
+        cnt++;
+        chunk_off += n;
+        chunk_pos += n;
+        limit -= n;
+    }
+    return cnt;
 }
+
 /// 将缓冲区中的数据写入文件描述符，返回写入的字节数
-int OutputBuffer::write2fd(int fd)
+int OutputBuffer::write2fd(int fd, int limit)
 {
-    assert(data_buf != nullptr && data_buf->head == 0);
+    assert(length() > 0);
 
+    struct iovec vec[MAX_IOV_NUM];
+    int cnt = fill_iovec(vec, MAX_IOV_NUM, limit);
     int already_write = 0;
 
-    do { 
-        already_write = write(fd, data_buf->data, data_buf->length);
+    do {
+        already_write = writev(fd, vec, cnt);
     } while (already_write == -1 && errno == EINTR);
 
     if (already_write > 0) {
-        data_buf->pop(already_write);
-        data_buf->adjust();
+        consume(already_write);
     }
 
     if (already_write == -1 && errno == EAGAIN) {
@@ -152,4 +311,4 @@ int OutputBuffer::write2fd(int fd)
     }
 
     return already_write;
-}
\ No newline at end of file
+}
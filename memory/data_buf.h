@@ -1,9 +1,16 @@
 #ifndef __DATA_BUF_H__
-#define __DATA_NIF_H__
+#define __DATA_BUF_H__
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <deque>
 
 #include "chunk.h"
 #include "mem_pool.h"
+#include "shared_buf.h"
 
+/// 应用层缓冲区，由内存池中的chunk串成的链表。
+/// 数据超过当前chunk时在尾部追加新的chunk，不再申请更大的chunk并拷贝全部数据，pop时释放读完的chunk。
 class BufferBase {
 public:
     BufferBase();
@@ -14,25 +21,70 @@ public:
     void clear();
 
 protected:
-    Chunk *data_buf{ nullptr };
+    /// 在链表尾部追加一个至少能容纳size字节的chunk
+    Chunk *append_chunk(int size);
+    /// 尾部chunk中还能写入的字节数
+    int tail_space() const;
+    /// 把数据复制到链表尾部，空间不足时追加chunk，成功返回0
+    int append(const char *data, int len);
+
+    Chunk *data_buf{ nullptr };     ///第一个chunk
+    Chunk *data_tail{ nullptr };    ///最后一个chunk
+    int data_length{ 0 };           ///所有chunk中的数据总长度
 };
 
-class InputBuffer : public BufferBase 
+class InputBuffer : public BufferBase
 {
 public:
-    int read_from_fd(int fd);
+    /// readv读到尾部chunk的剩余空间和栈上的临时缓冲区，临时缓冲区中的数据再追加到链表中。
+    /// 读到的字节数少于提供的空间时把*drained置为true，说明内核缓冲区已经读空，不需要再读一次得到EAGAIN
+    int read_from_fd(int fd, bool *drained = nullptr);
 
-    const char *get_from_buf() const;
+    /// 接管已经装有数据的chunk（比如io_uring选择的接收缓冲区）。数据能放进尾部chunk时复制后归还chunk，
+    /// 否则直接挂到链表尾部，不复制
+    void take_chunk(Chunk *chunk);
 
-    void adjust();
+    /// 返回开头len字节连续的数据，这些数据跨多个chunk时先合并到一个chunk中，
+    /// len超过缓冲区长度或最大的chunk、合并失败时返回nullptr
+    const char *get_from_buf(int len);
+    const char *get_from_buf() { return get_from_buf(data_length); }
 };
 
-class OutputBuffer : public BufferBase 
+/// 输出缓冲区除了chunk链表，还可以按顺序挂上共享缓冲区，共享缓冲区的数据不拷贝
+class OutputBuffer : public BufferBase
 {
 public:
+    /// writev一次最多写出的片段个数
+    static constexpr int MAX_IOV_NUM = 64;
+
+    /// chunk中的数据和共享缓冲区中未发送的数据之和
+    const int length() const { return data_length + ob_shared_len; }
+    void clear();
+
     int write2buf(const char *data, int len);
+    /// 只增加引用，发送时writev直接指向共享缓冲区
+    int write2buf(const SharedBufSP& buf);
+
+    /// writev一次写出链表中的多个chunk和共享缓冲区，最多写出limit字节，limit小于0时不限制
+    int write2fd(int fd, int limit = -1);
+
+    /// 按写入顺序把最多limit字节的数据填入vec，不消耗数据，返回填入的片段个数。
+    /// 异步发送时先填iovec，发送完成后再consume，期间不能修改缓冲区
+    int fill_iovec(struct iovec *vec, int max_cnt, int limit);
+    /// 按写入顺序从头部消耗len字节
+    void consume(int len);
+
+private:
+    /// 共享缓冲区片段，chunk_pos是它之前的chunk数据在chunk数据流中的位置
+    struct SharedSeg {
+        SharedBufSP buf;
+        int offset;
+        uint64_t chunk_pos;
+    };
 
-    int write2fd(int fd);
+    std::deque<SharedSeg> ob_shared;
+    int ob_shared_len{ 0 };
+    uint64_t ob_chunk_popped{ 0 };  ///已经发送的chunk数据总字节数
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,108 +1,397 @@
 #include <assert.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <new>
 
 #include "../log/pr.h"
 #include "mem_pool.h"
-/// 初始化内存池,分配chunk_num个size大小的内存块，通过链表的方式连接起来
-void Mempool::mem_init(MEM_CAP size, int chunk_num)
-{
-    Chunk *prev; 
-    mp_pool[size] = new (std::nothrow) Chunk(size);
-    if (mp_pool[size] == nullptr) {
-        PR_ERROR("new chunk %d error", static_cast<int>(size));
-        exit(1);
-    }
-    prev = mp_pool[size];
-
-    for (int i = 1; i < chunk_num; i ++) {
-        prev->next = new (std::nothrow)Chunk(size);
-        if (prev->next == nullptr) {
-            PR_ERROR("new chunk m4K error");
-            exit(1);
-        }
-        prev = prev->next;
+/// 每个规格一次在线程缓存和全局链表之间搬移的chunk个数，缓存超过两批时还回一批
+static const int BATCH_NUM[MEM_CAP_NUM] = { 32, 16, 8, 4, 2, 1 };
+/// 每个规格默认的目标个数，各一个slab
+static const int DEFAULT_TARGET[MEM_CAP_NUM] = { 1024, 256, 64, 16, 4, 1 };
+
+static inline size_t slab_size(int index)
+{
+    return std::max<size_t>(MEM_SLAB_SIZE, Mempool::class_size(index));
+}
+
+int Mempool::current_node()
+{
+    unsigned cpu = 0, node = 0;
+    if (getcpu(&cpu, &node) != 0 || node >= MEM_MAX_NODE_NUM) {
+        return 0;
+    }
+    return static_cast<int>(node);
+}
+
+int Mempool::cache_node(ThreadCache& cache)
+{
+    if (cache.tc_node < 0) {
+        cache.tc_node = current_node();
     }
-    mp_total_size_kb += size/1024 * chunk_num;
+    return cache.tc_node;
 }
-/// 构造函数,初始化内存池 ,提前分配不同大小的内存块   4K 16K 64K 256K 1M 4M
+
+/// 构造时不预先分配，chunk在第一次申请或warm_up时按slab建立
 Mempool::Mempool() : mp_total_size_kb(0), mp_left_size_kb(0)
 {
-    mem_init(m4K, 2000);
-    mem_init(m16K, 500);
-    mem_init(m64K, 250);
-    mem_init(m256K, 100);
-    mem_init(m1M, 25);
-    mem_init(m4M, 10);
-    mp_left_size_kb = mp_total_size_kb;
+    std::copy(DEFAULT_TARGET, DEFAULT_TARGET + MEM_CAP_NUM, mp_target);
 }
-/// 申请内存，根据大小，从内存池中找到合适的内存块
-Chunk *Mempool::alloc_chunk(int n) 
+
+Mempool::~Mempool()
 {
-    int index;
-    bool found = false;
-    for(index = mLow; index <= mUp; index = index * MEM_CAP_MULTI_POWER)
     {
-        if(n <= index)
-        {
-            found = true;
-            break;
+        lock_guard<mutex> lck(mp_mutex);
+        mp_trim_stop = true;
+    }
+    mp_trim_cv.notify_all();
+    if (mp_trim_thread.joinable()) {
+        mp_trim_thread.join();
+    }
+}
+/// 线程退出时把缓存的chunk全部还给全局链表
+Mempool::ThreadCache::~ThreadCache()
+{
+    for (int index = 0; index < MEM_CAP_NUM; index++) {
+        if (tc_cnt[index] > 0) {
+            Mempool::get_instance().spill(*this, index, tc_cnt[index]);
+        }
+    }
+}
+void Mempool::bind_node(int node)
+{
+    if (node < 0 || node >= MEM_MAX_NODE_NUM) {
+        node = 0;
+    }
+    ThreadCache& cache = local_cache();
+    if (cache.tc_node == node) {
+        return;
+    }
+    //之前缓存的chunk还给原来的节点
+    for (int index = 0; index < MEM_CAP_NUM; index++) {
+        if (cache.tc_cnt[index] > 0) {
+            spill(cache, index, cache.tc_cnt[index]);
         }
     }
+    cache.tc_node = node;
+}
+void Mempool::set_limit_kb(uint64_t kb)
+{
+    lock_guard<mutex> lck(mp_mutex);
+    mp_limit_kb = kb;
+}
+
+uint64_t Mempool::used_kb()
+{
+    lock_guard<mutex> lck(mp_mutex);
+    return mp_total_size_kb - mp_left_size_kb;
+}
+
+uint64_t Mempool::resident_kb()
+{
+    lock_guard<mutex> lck(mp_mutex);
+    return mp_resident_kb;
+}
+
+void Mempool::set_target(MEM_CAP size, int chunk_num)
+{
+    int index = size_class(size);
+    if (index < 0) {
+        return;
+    }
+    lock_guard<mutex> lck(mp_mutex);
+    mp_target[index] = chunk_num;
+}
 
-    if(!found)
+void Mempool::set_trim_interval_ms(int ms)
+{
     {
+        lock_guard<mutex> lck(mp_mutex);
+        mp_trim_interval_ms = ms;
+    }
+    mp_trim_cv.notify_all();
+}
+/// 调用者已经在锁内预留了slab的大小
+Mempool::Slab *Mempool::new_slab(int index, Chunk **first, Chunk **last)
+{
+    int size = class_size(index);
+    size_t bytes = slab_size(index);
+    int cnt = bytes / size;
+    void *base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    Slab *slab = base == MAP_FAILED ? nullptr : new (std::nothrow) Slab;
+    Chunk *chunks = slab == nullptr ? nullptr : static_cast<Chunk*>(::operator new(sizeof(Chunk) * cnt, std::nothrow));
+    if (chunks == nullptr) {
+        PR_ERROR("new slab of %dkb chunk error\n", size/1024);
+        delete slab;
+        if (base != MAP_FAILED) {
+            munmap(base, bytes);
+        }
+        lock_guard<mutex> lck(mp_mutex);
+        mp_total_size_kb -= bytes/1024;
         return nullptr;
     }
+    slab->sl_base = static_cast<char*>(base);
+    slab->sl_size = bytes;
+    slab->sl_index = index;
+    slab->sl_chunk_cnt = cnt;
+    slab->sl_chunks = chunks;
+    for (int i = 0; i < cnt; i++) {
+        new (&chunks[i]) Chunk(size, slab->sl_base + (size_t)i * size, slab);
+        chunks[i].next = i + 1 < cnt ? &chunks[i + 1] : nullptr;
+    }
+    *first = &chunks[0];
+    *last = &chunks[cnt - 1];
+    return slab;
+}
 
-    lock_guard<mutex> lck(mp_mutex);
-    if (mp_pool[index] == nullptr) {
-        if (mp_total_size_kb + index/1024 >= MAX_POOL_SIZE) {
-            PR_ERROR("beyond the limit size of memory!\n");
-            exit(1);
+void Mempool::push_free(int node, int index, Chunk *first, Chunk *last, int num)
+{
+    for (Chunk *c = first; ; c = c->next) {
+        static_cast<Slab*>(c->slab)->sl_free_cnt++;
+        if (c == last) {
+            break;
         }
+    }
+    last->next = mp_pool[node][index];
+    mp_pool[node][index] = first;
+    mp_pool_cnt[node][index] += num;
+    mp_left_size_kb += class_size(index)/1024 * num;
+}
 
-        Chunk *new_buf = new (std::nothrow) Chunk(index);
-        if (new_buf == nullptr) {
-            PR_ERROR("new chunk error\n");
-            exit(1);
+bool Mempool::warm_up()
+{
+    int node = cache_node(local_cache());
+    for (int index = 0; index < MEM_CAP_NUM; index++) {
+        while (true) {
+            {
+                lock_guard<mutex> lck(mp_mutex);
+                if (mp_pool_cnt[node][index] >= mp_target[index]) {
+                    break;
+                }
+                if (mp_total_size_kb + slab_size(index)/1024 > mp_limit_kb) {
+                    PR_ERROR("beyond the limit size of memory!\n");
+                    return false;
+                }
+                mp_total_size_kb += slab_size(index)/1024;
+            }
+            Chunk *first, *last;
+            Slab *slab = new_slab(index, &first, &last);
+            if (slab == nullptr) {
+                return false;
+            }
+            //由本线程写入，物理页分配在本节点上
+            long page = sysconf(_SC_PAGESIZE);
+            for (size_t off = 0; off < slab->sl_size; off += page) {
+                slab->sl_base[off] = 0;
+            }
+            lock_guard<mutex> lck(mp_mutex);
+            mp_slabs.push_back(slab);
+            mp_resident_kb += slab->sl_size/1024;
+            push_free(node, index, first, last, slab->sl_chunk_cnt);
         }
-        mp_total_size_kb += index/1024;
-        return new_buf;
+    }
+    return true;
+}
+/// 整理时持有全局锁，取出chunk也要加锁，不会有chunk在madvise的同时被使用
+uint64_t Mempool::trim_locked()
+{
+    int resident_free[MEM_CAP_NUM] = {};
+    for (Slab *slab : mp_slabs) {
+        if (!slab->sl_trimmed) {
+            resident_free[slab->sl_index] += slab->sl_free_cnt;
+        }
+    }
+    uint64_t freed_kb = 0;
+    for (Slab *slab : mp_slabs) {
+        bool idle = slab->sl_trim_seq == slab->sl_use_seq;
+        slab->sl_trim_seq = slab->sl_use_seq;
+        if (slab->sl_trimmed || slab->sl_free_cnt != slab->sl_chunk_cnt || !idle) {
+            continue;
+        }
+        int index = slab->sl_index;
+        if (resident_free[index] - slab->sl_chunk_cnt < mp_target[index]) {
+            continue;
+        }
+        if (madvise(slab->sl_base, slab->sl_size, MADV_DONTNEED) != 0) {
+            continue;
+        }
+        slab->sl_trimmed = true;
+        resident_free[index] -= slab->sl_chunk_cnt;
+        freed_kb += slab->sl_size/1024;
+    }
+    mp_resident_kb -= freed_kb;
+    return freed_kb;
+}
+
+uint64_t Mempool::trim()
+{
+    lock_guard<mutex> lck(mp_mutex);
+    return trim_locked();
+}
+
+void Mempool::trim_loop()
+{
+    unique_lock<mutex> lck(mp_mutex);
+    while (!mp_trim_stop) {
+        if (mp_trim_interval_ms > 0) {
+            mp_trim_cv.wait_for(lck, chrono::milliseconds(mp_trim_interval_ms));
+        }
+        else {
+            mp_trim_cv.wait(lck);
+        }
+        if (!mp_trim_stop && mp_trim_interval_ms > 0) {
+            trim_locked();
+        }
+    }
+}
+/// 申请内存，根据大小，从本线程缓存中找到合适的内存块
+Chunk *Mempool::alloc_chunk(int n) 
+{
+    int index = size_class(n);
+    if (index < 0) {
+        return nullptr;
     }
 
-    Chunk *target = mp_pool[index];
-    mp_pool[index] = target->next;
+    ThreadCache& cache = local_cache();
+    if (cache.tc_list[index] == nullptr && !refill(cache, index)) {
+        return nullptr;
+    }
+
+    Chunk *target = cache.tc_list[index];
+    cache.tc_list[index] = target->next;
+    cache.tc_cnt[index]--;
     target->next = nullptr;
-    mp_left_size_kb -= index/1024;
 
     return target;
 }
-/// 释放内存，将内存块放回内存池
+/// 从全局链表中取一批chunk，一次加锁
+bool Mempool::refill(ThreadCache& cache, int index)
+{
+    int node = cache_node(cache);
+    {
+        lock_guard<mutex> lck(mp_mutex);
+        //本节点的链表为空，达到上限时才使用其他节点的chunk
+        int from = node;
+        if (mp_pool[node][index] == nullptr && mp_total_size_kb + slab_size(index)/1024 > mp_limit_kb) {
+            for (int i = 0; i < MEM_MAX_NODE_NUM; i++) {
+                if (mp_pool[i][index] != nullptr) {
+                    from = i;
+                    break;
+                }
+            }
+        }
+        if (mp_pool[from][index] != nullptr) {
+            Chunk *first = mp_pool[from][index];
+            Chunk *last = first;
+            int num = 1;
+            while (true) {
+                Slab *slab = static_cast<Slab*>(last->slab);
+                slab->sl_free_cnt--;
+                slab->sl_use_seq++;
+                if (slab->sl_trimmed) {
+                    //已经还给系统的slab重新使用，写入时由内核分配物理页
+                    slab->sl_trimmed = false;
+                    mp_resident_kb += slab->sl_size/1024;
+                }
+                if (num == BATCH_NUM[index] || last->next == nullptr) {
+                    break;
+                }
+                last = last->next;
+                num++;
+            }
+            mp_pool[from][index] = last->next;
+            mp_pool_cnt[from][index] -= num;
+            mp_left_size_kb -= class_size(index)/1024 * num;
+
+            last->next = cache.tc_list[index];
+            cache.tc_list[index] = first;
+            cache.tc_cnt[index] += num;
+            return true;
+        }
+
+        if (mp_total_size_kb + slab_size(index)/1024 > mp_limit_kb) {
+            PR_ERROR("beyond the limit size of memory!\n");
+            return false;
+        }
+        mp_total_size_kb += slab_size(index)/1024;
+    }
+
+    //全局链表也为空，在锁外新建一个slab，由本线程第一次写入，物理内存分配在本节点上。
+    //一批放入缓存，其余挂到本节点的全局链表
+    Chunk *first, *last;
+    Slab *slab = new_slab(index, &first, &last);
+    if (slab == nullptr) {
+        return false;
+    }
+    int num = min(BATCH_NUM[index], slab->sl_chunk_cnt);
+    Chunk *batch_last = &slab->sl_chunks[num - 1];
+    Chunk *rest = batch_last->next;
+    slab->sl_use_seq = 1;
+
+    batch_last->next = cache.tc_list[index];
+    cache.tc_list[index] = first;
+    cache.tc_cnt[index] += num;
+
+    lock_guard<mutex> lck(mp_mutex);
+    mp_slabs.push_back(slab);
+    mp_resident_kb += slab->sl_size/1024;
+    if (rest != nullptr) {
+        push_free(node, index, rest, last, slab->sl_chunk_cnt - num);
+    }
+    if (!mp_trim_thread.joinable() && !mp_trim_stop) {
+        mp_trim_thread = thread([this](){ this->trim_loop(); });
+    }
+    return true;
+}
+/// 释放内存，将内存块放回本线程缓存
 void Mempool::retrieve(Chunk *block)
 {
-    int index = block->capacity;
+    int index = size_class(block->capacity);
+    assert(index >= 0 && class_size(index) == block->capacity);
     block->length = 0;
     block->head = 0;
 
-    lock_guard<mutex> lck(mp_mutex);
-    assert(mp_pool.find(index) != mp_pool.end());
+    ThreadCache& cache = local_cache();
+    block->next = cache.tc_list[index];
+    cache.tc_list[index] = block;
+    cache.tc_cnt[index]++;
 
-    block->next = mp_pool[index];
-    mp_pool[index] = block;
-    mp_left_size_kb += block->capacity/1024;
+    if (cache.tc_cnt[index] > 2 * BATCH_NUM[index]) {
+        spill(cache, index, BATCH_NUM[index]);
+    }
+}
+/// 把缓存中的num个chunk先在锁外串好，再一次加锁挂到全局链表头部
+void Mempool::spill(ThreadCache& cache, int index, int num)
+{
+    Chunk *first = cache.tc_list[index];
+    Chunk *last = first;
+    for (int i = 1; i < num; i++) {
+        last = last->next;
+    }
+    cache.tc_list[index] = last->next;
+    cache.tc_cnt[index] -= num;
+
+    int node = cache_node(cache);
+    lock_guard<mutex> lck(mp_mutex);
+    push_free(node, index, first, last, num);
 }
 
 int Mempool::get_list_size_byte(MEM_CAP index)
 {
     int size = 0;
     lock_guard<mutex> lck(mp_mutex);
-    assert(mp_pool.find(index) != mp_pool.end());
-    Chunk *node = mp_pool[index];
+    for (int i = 0; i < MEM_MAX_NODE_NUM; i++) {
+        Chunk *node = mp_pool[i][size_class(index)];
 
-    while(node)
-    {
-        size += node->capacity;
-        node = node->next;
-    } 
+        while(node)
+        {
+            size += node->capacity;
+            node = node->next;
+        } 
+    }
 
     return size;
 }
@@ -112,8 +401,7 @@ void Mempool::print_list_content(MEM_CAP index)
     lock_guard<mutex> lck(mp_mutex);
     int cnt = 0;
     printf("***************start to print %dkb chunk_size list data*******************\n", index/1024);
-    assert(mp_pool.find(index) != mp_pool.end());
-    Chunk *node = mp_pool[index];
+    Chunk *node = mp_pool[current_node()][size_class(index)];
 
     while (node)
     {
@@ -1,16 +1,19 @@
 #ifndef __MEM_POOL_H__
 #define __MEM_POOL_H__
 
-#include <unordered_map>
+#include <stdint.h>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
 
 #include "chunk.h"
 
 using namespace std;
 
-typedef unordered_map<int, Chunk*> pool_t;
-
 #define MEM_CAP_MULTI_POWER (4)
+#define MEM_CAP_NUM (6)
+#define MEM_MAX_NODE_NUM (8)
 
 typedef enum {
     mLow    = 4096,
@@ -24,6 +27,8 @@ typedef enum {
 } MEM_CAP;
 
 #define MAX_POOL_SIZE (4U *1024 *1024) 
+/// chunk的数据从一次mmap的slab中切出来，更大的规格一个slab一个chunk
+#define MEM_SLAB_SIZE (4U *1024 *1024)
 
 class Mempool 
 {
@@ -33,15 +38,47 @@ public:
         return mp_instance;
     }
 
+    /// 先从本线程的缓存中分配，缓存为空时从全局链表批量取一批。
+    /// 达到内存上限或系统内存不足时返回nullptr，由调用者放弃这次操作，不退出进程
     Chunk *alloc_chunk(int n);
     Chunk *alloc_chunk() { return alloc_chunk(m4K); }
 
+    /// 放回本线程的缓存，缓存过多时批量还给全局链表
     void retrieve(Chunk *block);
 
-    // FIXME: use smart ptr to manage chunk or add destroy interface to recycle memory.
-    // static void destroy();
+    /// 设置本线程所在的NUMA节点，线程绑定cpu之后调用。之后本线程只从该节点的全局链表取还chunk，
+    /// 新建的chunk由本线程第一次写入，物理内存分配在本节点上。不调用时按第一次分配时运行的cpu确定节点
+    void bind_node(int node);
+
+    /// 内存池新建chunk的总大小上限，默认MAX_POOL_SIZE KB
+    void set_limit_kb(uint64_t kb);
+    /// 已经分配出去的大小，包括线程缓存中的chunk
+    uint64_t used_kb();
+
+    /// 每个规格的目标个数：warm_up预先建好这么多chunk，整理时全局链表中常驻的空闲chunk不少于这个数
+    void set_target(MEM_CAP size, int chunk_num);
+    /// 按目标个数在本线程所在的节点上建好chunk并写入一次，启动时不调用则在第一次申请时才建
+    bool warm_up();
+    /// 把空闲了一个整理周期的slab用madvise(MADV_DONTNEED)还给系统，返回还回的KB数。
+    /// chunk仍然留在全局链表中，再次使用时由内核重新分配物理页
+    uint64_t trim();
+    /// 后台整理线程的周期，0表示不在后台整理，整理线程在建第一个slab时启动
+    void set_trim_interval_ms(int ms);
+    /// 占用物理内存的slab大小之和，已经整理的slab不计入
+    uint64_t resident_kb();
+
+    /// 容纳n字节的最小chunk规格的下标，4K为0，每级乘4，超过4M返回-1
+    static int size_class(int n) {
+        if (n <= mLow) {
+            return 0;
+        }
+        int bits = 32 - __builtin_clz(static_cast<unsigned>(n - 1));
+        int index = (bits - 11) / 2;
+        return index < MEM_CAP_NUM ? index : -1;
+    }
+    static int class_size(int index) { return mLow << (2 * index); }
 
-    ~Mempool() = default;
+    ~Mempool();
 
     // api for debug
     [[deprecated("mem pool debug api deprecated!")]]
@@ -60,12 +97,63 @@ private:
     Mempool& operator=(const Mempool&) = delete;
     Mempool& operator=(Mempool&&) = delete;
 
-    void mem_init(MEM_CAP size, int chunk_num);
+    /// 一次mmap的大块内存，切成同一规格的chunk，chunk的slab指向它
+    struct Slab {
+        char *sl_base;
+        size_t sl_size;
+        int sl_index;
+        int sl_chunk_cnt;
+        int sl_free_cnt{ 0 };       ///在全局链表中的chunk个数，等于sl_chunk_cnt时整个slab空闲
+        uint64_t sl_use_seq{ 0 };   ///从全局链表取出chunk的次数
+        uint64_t sl_trim_seq{ 0 };  ///上一次整理时的sl_use_seq，没有变化说明空闲了一个周期
+        bool sl_trimmed{ false };
+        Chunk *sl_chunks;
+    };
+
+    /// 每个线程（每个EventLoop）一份的chunk缓存，线程退出时还给全局链表
+    struct ThreadCache {
+        Chunk *tc_list[MEM_CAP_NUM]{};
+        int tc_cnt[MEM_CAP_NUM]{};
+        int tc_node{ -1 };
+
+        ~ThreadCache();
+    };
+
+    static ThreadCache& local_cache() {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
 
-    pool_t mp_pool;
+    /// 调用线程当前所在的NUMA节点
+    static int current_node();
+    static int cache_node(ThreadCache& cache);
+
+    /// 在锁外mmap一个slab并切成chunk，chunk串成链表从first返回。失败时撤销预留的大小，返回nullptr
+    Slab *new_slab(int index, Chunk **first, Chunk **last);
+    /// 把first到last的chunk挂到节点的全局链表，调用者持有锁
+    void push_free(int node, int index, Chunk *first, Chunk *last, int num);
+    /// 从本节点的全局链表取一批chunk放入缓存，全局链表为空时新建一个slab，
+    /// 达到内存上限时才从其他节点的链表取
+    bool refill(ThreadCache& cache, int index);
+    uint64_t trim_locked();
+    void trim_loop();
+    /// 把缓存链表头部的num个chunk还给本节点的全局链表
+    void spill(ThreadCache& cache, int index, int num);
+
+    Chunk *mp_pool[MEM_MAX_NODE_NUM][MEM_CAP_NUM]{};  ///每个NUMA节点的全局空闲链表，以规格下标索引
+    int mp_pool_cnt[MEM_MAX_NODE_NUM][MEM_CAP_NUM]{};
     uint64_t mp_total_size_kb;
-    uint64_t mp_left_size_kb;
+    uint64_t mp_left_size_kb;           ///全局链表中空闲的大小，不包含线程缓存中的chunk
+    uint64_t mp_limit_kb{ MAX_POOL_SIZE };
+    uint64_t mp_resident_kb{ 0 };
+    int mp_target[MEM_CAP_NUM];
+    vector<Slab*> mp_slabs;
     mutex mp_mutex;
+
+    thread mp_trim_thread;
+    condition_variable mp_trim_cv;
+    int mp_trim_interval_ms{ 1000 };
+    bool mp_trim_stop{ false };
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef __SHARED_BUF_H__
+#define __SHARED_BUF_H__
+
+#include <memory>
+#include <string>
+
+using namespace std;
+
+/// 创建之后不再修改的引用计数缓冲区。
+/// 缓存的响应、错误页面、预先生成的首部可以同时挂在多个连接的输出缓冲区上，
+/// writev直接指向其中的数据，不拷贝；最后一个连接发送完之后释放
+class SharedBuffer
+{
+public:
+    explicit SharedBuffer(string data) : sb_data(move(data)) {}
+
+    SharedBuffer(const SharedBuffer&) = delete;
+    SharedBuffer& operator=(const SharedBuffer&) = delete;
+
+    const char *data() const { return sb_data.data(); }
+    int size() const { return static_cast<int>(sb_data.size()); }
+
+private:
+    const string sb_data;
+};
+
+typedef shared_ptr<const SharedBuffer> SharedBufSP;
+
+inline SharedBufSP make_shared_buf(string data)
+{
+    return make_shared<const SharedBuffer>(move(data));
+}
+
+#endif
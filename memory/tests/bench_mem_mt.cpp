@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "mem_pool.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_mem_mt [每个线程的操作次数] [线程数...]
+// 每个线程保留一组存活的chunk，随机释放一个再申请一个新的，大小按4K到256K的比例分布，
+// 模拟多个io线程同时收发数据时对内存池的压力，统计所有线程每秒完成的申请+释放次数
+
+const int LIVE_NUM = 64;
+
+void worker(int ops, int seed)
+{
+    //大部分是4K的读写缓冲区，少量大块
+    static const int sizes[] = { m4K, m4K, m4K, m4K, m4K, m4K, m16K, m16K, m64K, m256K };
+    mt19937 rng(seed);
+    vector<Chunk*> live(LIVE_NUM);
+    for (auto& c : live) {
+        c = Mempool::get_instance().alloc_chunk(sizes[rng() % 10]);
+    }
+
+    for (int i = 0; i < ops; i++) {
+        unsigned r = rng();
+        Chunk *&c = live[r % LIVE_NUM];
+        Mempool::get_instance().retrieve(c);
+        c = Mempool::get_instance().alloc_chunk(sizes[(r >> 8) % 10]);
+        assert(c != nullptr && c->length == 0);
+        c->data[0] = static_cast<char>(i);
+    }
+
+    for (auto c : live) {
+        Mempool::get_instance().retrieve(c);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+
+    int ops = argc > 1 ? atoi(argv[1]) : 1000000;
+    vector<int> thread_nums;
+    for (int i = 2; i < argc; i++) {
+        thread_nums.push_back(atoi(argv[i]));
+    }
+    if (thread_nums.empty()) {
+        thread_nums = { 1, 2, 4, 8 };
+    }
+
+    for (int n : thread_nums) {
+        auto t1 = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (int i = 0; i < n; i++) {
+            threads.emplace_back(worker, ops, i + 1);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - t1).count();
+        PR_INFO("threads %d, alloc+retrieve %lld, %.2f M ops/s\n", n, (long long)n * ops, n * ops / sec / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "mem_pool.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_mem_startup [负载MB]
+// 统计内存池构造的耗时和常驻内存（RSS）的增量、第一次申请的耗时，然后申请并写满一批不同规格的chunk再全部释放，
+// 对比释放后和两次trim（slab要空闲一个整理周期）之后的RSS，最后统计按目标个数warm_up的耗时
+
+typedef chrono::steady_clock Clock;
+
+long rss_kb()
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp == nullptr) {
+        return 0;
+    }
+    char line[256];
+    long kb = 0;
+    while (fgets(line, sizeof line, fp) != nullptr) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            kb = atol(line + 6);
+            break;
+        }
+    }
+    fclose(fp);
+    return kb;
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+    long load_mb = argc > 1 ? atol(argv[1]) : 256;
+    //由这里手动整理，不让后台线程提前整理
+    long rss0 = rss_kb();
+
+    auto t1 = Clock::now();
+    Mempool& pool = Mempool::get_instance();
+    auto t2 = Clock::now();
+    pool.set_trim_interval_ms(0);
+    long rss1 = rss_kb();
+    Chunk *first = pool.alloc_chunk(m4K);
+    auto t3 = Clock::now();
+    pool.retrieve(first);
+    PR_INFO("construct %.3f ms, rss +%ld KB, first alloc %.1f us\n",
+                chrono::duration<double, milli>(t2 - t1).count(), rss1 - rss0,
+                chrono::duration<double, micro>(t3 - t2).count());
+
+    static const int sizes[] = { m4K, m16K, m64K, m256K, m1M };
+    vector<Chunk*> chunks;
+    long total = 0;
+    for (int i = 0; total < load_mb * 1024 * 1024; i++) {
+        Chunk *c = pool.alloc_chunk(sizes[i % 5]);
+        if (c == nullptr) {
+            PR_ERROR("alloc chunk failed\n");
+            return 1;
+        }
+        memset(c->data, 1, c->capacity);
+        total += c->capacity;
+        chunks.push_back(c);
+    }
+    long rss_peak = rss_kb();
+    for (Chunk *c : chunks) {
+        pool.retrieve(c);
+    }
+    long rss_free = rss_kb();
+    pool.trim();
+    auto t4 = Clock::now();
+    uint64_t trimmed = pool.trim();
+    auto t5 = Clock::now();
+    PR_INFO("load %ld MB: rss peak +%ld KB, after retrieve +%ld KB, after trim +%ld KB (trimmed %llu KB in %.2f ms, resident %llu KB)\n",
+                load_mb, rss_peak - rss0, rss_free - rss0, rss_kb() - rss0, (unsigned long long)trimmed,
+                chrono::duration<double, milli>(t5 - t4).count(), (unsigned long long)pool.resident_kb());
+
+    auto t6 = Clock::now();
+    bool ok = pool.warm_up();
+    auto t7 = Clock::now();
+    PR_INFO("warm up %s in %.2f ms, resident %llu KB\n", ok ? "done" : "failed",
+                chrono::duration<double, milli>(t7 - t6).count(), (unsigned long long)pool.resident_kb());
+    return 0;
+}
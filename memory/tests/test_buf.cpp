@@ -1,9 +1,146 @@
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <string>
 
 #include "data_buf.h"
 #include "log.h"
 
+/// 1M数据经过多个chunk组成的缓冲区在socketpair中传输，内容不变
+void test_chunk_chain()
+{
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    std::string expect;
+    for (int i = 0; expect.size() < 1024 * 1024; i++) {
+        expect.append(std::to_string(i));
+        expect.push_back(' ');
+    }
+
+    OutputBuffer ob;
+    //先写小块，再写一个超过单个chunk的大块
+    size_t small_len = 3000;
+    for (size_t off = 0; off < small_len; off += 100) {
+        assert(ob.write2buf(expect.data() + off, 100) == 0);
+    }
+    assert(ob.write2buf(expect.data() + small_len, expect.size() - small_len) == 0);
+    assert(ob.length() == (int)expect.size());
+
+    InputBuffer ib;
+    while (ob.length() > 0 || ib.length() < (int)expect.size()) {
+        if (ob.length() > 0) {
+            assert(ob.write2fd(fds[0]) >= 0);
+        }
+        int ret;
+        while ((ret = ib.read_from_fd(fds[1])) > 0);
+        assert(ret == -1 && errno == EAGAIN);
+    }
+    assert(ib.length() == (int)expect.size());
+
+    //pop一部分之后合并剩下的数据
+    ib.pop(12345);
+    const char *data = ib.get_from_buf();
+    assert(data != nullptr);
+    assert(std::string(data, ib.length()) == expect.substr(12345));
+    ib.pop(ib.length());
+    assert(ib.length() == 0 && ib.get_from_buf() == nullptr);
+
+    close(fds[0]);
+    close(fds[1]);
+    LOG_INFO("chunk chain buffer test passed\n");
+}
+
+/// 只合并开头的数据；合并后留出的空间继续接收数据，不再重新合并
+void test_merge_prefix()
+{
+    InputBuffer ib;
+    std::string expect;
+    for (int i = 0; i < 21; i++) {
+        Chunk *chunk = Mempool::get_instance().alloc_chunk(m256K);
+        assert(chunk != nullptr);
+        memset(chunk->data, 'a' + i, m256K);
+        chunk->length = m256K;
+        ib.take_chunk(chunk);
+        expect.append(m256K, 'a' + i);
+    }
+
+    //超过最大的chunk，不能全部合并
+    assert(ib.get_from_buf() == nullptr);
+    const char *data = ib.get_from_buf(mUp);
+    assert(data != nullptr && std::string(data, mUp) == expect.substr(0, mUp));
+    assert(ib.length() == (int)expect.size());
+    ib.pop(mUp);
+    data = ib.get_from_buf();
+    assert(data != nullptr && std::string(data, ib.length()) == expect.substr(mUp));
+    ib.pop(ib.length());
+
+    Chunk *chunk = Mempool::get_instance().alloc_chunk(m4K);
+    memset(chunk->data, 'x', m4K);
+    chunk->length = m4K;
+    ib.take_chunk(chunk);
+    chunk = Mempool::get_instance().alloc_chunk(m64K);
+    memset(chunk->data, 'y', m64K);
+    chunk->length = m64K;
+    ib.take_chunk(chunk);
+    data = ib.get_from_buf();
+    chunk = Mempool::get_instance().alloc_chunk(m4K);
+    memset(chunk->data, 'z', m4K);
+    chunk->length = m4K;
+    ib.take_chunk(chunk);
+    assert(ib.get_from_buf() == data);
+    assert(std::string(data, ib.length()) == std::string(m4K, 'x') + std::string(m64K, 'y') + std::string(m4K, 'z'));
+
+    LOG_INFO("merge prefix test passed\n");
+}
+
+/// 共享缓冲区和普通数据交替写入，按写入顺序发送；每次最多写limit字节，覆盖共享缓冲区被拆开发送的情况
+void test_shared_buf()
+{
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    SharedBufSP page = make_shared_buf(std::string(100 * 1024, 'p'));
+    SharedBufSP head = make_shared_buf("HEAD");
+    OutputBuffer ob;
+    std::string expect;
+    for (int i = 0; i < 20; i++) {
+        std::string line = std::to_string(i) + ":";
+        ob.write2buf(line.data(), line.size());
+        ob.write2buf(head);
+        ob.write2buf(page);
+        expect += line + "HEAD" + std::string(100 * 1024, 'p');
+    }
+    assert(ob.length() == (int)expect.size());
+    //页面只有一份，所有片段共享
+    assert(page.use_count() == 21);
+
+    InputBuffer ib;
+    int limit = 1;
+    while (ob.length() > 0 || ib.length() < (int)expect.size()) {
+        if (ob.length() > 0) {
+            assert(ob.write2fd(fds[0], limit) >= 0);
+            limit = limit * 3 % 70001 + 1;
+        }
+        while (ib.read_from_fd(fds[1]) > 0);
+    }
+    assert(ib.length() == (int)expect.size());
+    const char *data = ib.get_from_buf();
+    assert(std::string(data, ib.length()) == expect);
+    assert(page.use_count() == 1);
+
+    close(fds[0]);
+    close(fds[1]);
+    LOG_INFO("shared buffer test passed\n");
+}
+
 int main()
 {
     Logger::get_instance()->init(NULL);
@@ -27,7 +164,7 @@ int main()
     int r_cnt = ib.read_from_fd(fd);
     LOG_INFO("read %d bytes from file by InputBuffer\n", r_cnt);
     const char *r_data = ib.get_from_buf();
-    LOG_INFO("data get from InputBuffer: %s", r_data);
+    LOG_INFO("data get from InputBuffer: %.*s\n", ib.length(), r_data);
     ib.clear();
 
     const char * w_data = "world";
@@ -40,9 +177,13 @@ int main()
     r_cnt = ib.read_from_fd(fd);
     LOG_INFO("read %d bytes from file by InputBuffer\n", r_cnt);
     r_data = ib.get_from_buf();
-    LOG_INFO("data get from buf: %s", r_data);    
+    LOG_INFO("data get from buf: %.*s\n", ib.length(), r_data);    
 
     fclose(fp);
 
+    test_chunk_chain();
+    test_shared_buf();
+    test_merge_prefix();
+
     return 0;
 }
\ No newline at end of file
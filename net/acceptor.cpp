@@ -11,17 +11,19 @@
 #include "../log/pr.h"
 #include "../log/log.h"
 #include "event_loop.h"
+#include "io_uring_poller.h"
 #include "tcp_server.h"
 #include "acceptor.h"
 
 using namespace std;
 ///Acceptor类的构造函数 
-Acceptor::Acceptor(TcpServer* server, EventLoop* loop, const char *ip, uint16_t port)
+Acceptor::Acceptor(TcpServer* server, EventLoop* loop, const char *ip, uint16_t port, bool reuse_port, int incoming_cpu)
     : ac_server(server),
       ac_loop(loop),
       ac_listening(false),
+      ac_reuse_port(reuse_port),
       ac_idle_fd(open("/dev/null", O_RDONLY | O_CLOEXEC)),
-      ac_listen_fd(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP))
+      ac_listen_fd(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP))
 {
     LOG_INFO("create one acceptor, listen fd is %d\n", ac_listen_fd);
     assert(ac_listen_fd >= 0);
@@ -31,6 +33,14 @@ Acceptor::Acceptor(TcpServer* server, EventLoop* loop, const char *ip, uint16_t
     if (setsockopt(ac_listen_fd, SOL_SOCKET, SO_REUSEADDR, &op, sizeof(op)) < 0) {
         PR_ERROR("set listen socket SO_REUSEADDR failed!\n");
     }
+    ///多个socket绑定同一个端口，由内核把新连接分散到各个监听socket上
+    if (ac_reuse_port && setsockopt(ac_listen_fd, SOL_SOCKET, SO_REUSEPORT, &op, sizeof(op)) < 0) {
+        PR_ERROR("set listen socket SO_REUSEPORT failed!\n");
+        exit(1);
+    }
+    if (incoming_cpu >= 0 && setsockopt(ac_listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &incoming_cpu, sizeof(incoming_cpu)) < 0) {
+        PR_ERROR("set listen socket SO_INCOMING_CPU failed!\n");
+    }
     ///绑定ip和端口 
     memset(&ac_server_addr, 0, sizeof(ac_server_addr));
     ac_server_addr.sin_family = AF_INET;
@@ -58,9 +68,44 @@ void Acceptor::listen()
         exit(1);
     }
     ac_listening = true;
+    if (IoUring *uring = ac_loop->get_uring(); uring != nullptr) {
+        //一个请求持续接受新连接，不需要等可读事件再循环accept到EAGAIN
+        uring->accept_multishot(ac_listen_fd, [this](int res){ this->on_accept(res); });
+        return;
+    }
     ac_loop->add_to_poller(ac_listen_fd, EPOLLIN, [this](){ this->do_accept(); });
 }
 
+void Acceptor::on_accept(int res)
+{
+    if (res < 0) {
+        if (res == -EMFILE) {
+            PR_WARN("accept fail, errno=EMFILE, use idle fd\n");
+            this->drop_one_connection();
+        }
+        else {
+            PR_ERROR("accept fail, error no:%d, error str:%s\n", -res, strerror(-res));
+        }
+        return;
+    }
+    //io_uring的accept不返回对端地址
+    struct sockaddr_in conn_addr;
+    socklen_t conn_addrlen = sizeof conn_addr;
+    if (getpeername(res, (struct sockaddr*)&conn_addr, &conn_addrlen) != 0) {
+        memset(&conn_addr, 0, sizeof conn_addr);
+        conn_addrlen = sizeof conn_addr;
+    }
+    this->new_connection(res, conn_addr, conn_addrlen);
+}
+
+void Acceptor::drop_one_connection()
+{
+    close(ac_idle_fd);
+    ac_idle_fd = accept(ac_listen_fd, NULL, NULL);
+    close(ac_idle_fd);
+    ac_idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
 void Acceptor::do_accept()
 {
     int connfd;
@@ -75,13 +120,10 @@ void Acceptor::do_accept()
             }
             else if (errno == EMFILE) {///EMFILE是一个错误码，表示进程已达到打开文件的限制。
                 PR_WARN("accept fail, errno=EMFILE, use idle fd\n");
-                close(ac_idle_fd);
-                ac_idle_fd = accept(ac_listen_fd, NULL, NULL);
-                close(ac_idle_fd);
-                ac_idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                this->drop_one_connection();
             }
             else if (errno == EAGAIN) {///没有更多的连接可以立即接受，即监听队列为空。
-                PR_ERROR("accept fail, errno=EAGAIN, break\n");
+                PR_DEBUG("accept fail, errno=EAGAIN, break\n");
                 break;
             }
             else {
@@ -90,18 +132,41 @@ void Acceptor::do_accept()
             }
         }
         else {
-            LOG_INFO("accepted one connection, sock fd is %d\n", connfd);
-            EventLoop* sub_loop = ac_server->get_next_loop();
-            //创建一个TcpConnection对象，将其加入到TcpServer的tcp连接列表中
-            TcpConnSP conn = make_shared<TcpConnection>(ac_server, sub_loop, connfd, conn_addr, conn_addrlen);
-            conn->set_connected_cb(ac_server->ts_connected_cb);
-            conn->set_message_cb(ac_server->ts_message_cb);
-            conn->set_close_cb(ac_server->ts_close_cb);
-            conn->add_task();
-            //加锁，将新的tcp连接加入到tcp连接列表中
-            lock_guard<mutex> lck(ac_server->ts_mutex);
-            ac_server->add_new_tcp_conn(conn);     
+            this->new_connection(connfd, conn_addr, conn_addrlen);
+        }
+    }
+}
+
+void Acceptor::new_connection(int connfd, struct sockaddr_in& conn_addr, socklen_t& conn_addrlen)
+{
+    LOG_INFO("accepted one connection, sock fd is %d\n", connfd);
+    if (ac_server->over_memory_budget()) {
+        //内存超过预算，拒绝新连接，先保证已有连接的收发
+        PR_WARN("memory over budget, refuse connection, sock fd is %d\n", connfd);
+        close(connfd);
+        return;
+    }
+    //SO_REUSEPORT模式下每个loop有自己的acceptor，连接留在本loop，不需要跨线程转交
+    //按收包cpu分配时，连接交给和网卡中断、协议栈处理在同一个cpu上的loop
+    EventLoop* sub_loop = ac_loop;
+    if (!ac_reuse_port) {
+        int cpu = -1;
+        socklen_t len = sizeof cpu;
+        if (!ac_server->ts_incoming_cpu || getsockopt(connfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) != 0) {
+            cpu = -1;
         }
+        sub_loop = ac_server->get_loop_by_cpu(cpu);
     }
+    //创建一个TcpConnection对象，由所属loop在自己的线程中注册
+    TcpConnSP conn = make_shared<TcpConnection>(ac_server, sub_loop, connfd, conn_addr, conn_addrlen);
+    conn->set_connected_cb(ac_server->ts_connected_cb);
+    conn->set_message_cb(ac_server->ts_conn_msg_cb);
+    conn->set_close_cb(ac_server->ts_close_cb);
+    conn->set_read_budget(ac_server->ts_read_budget);
+    conn->set_co_handler(ac_server->ts_co_handler);
+    conn->set_water_marks(ac_server->ts_high_water_mark, ac_server->ts_low_water_mark);
+    conn->set_high_water_cb(ac_server->ts_high_water_cb);
+    conn->set_low_water_cb(ac_server->ts_low_water_cb);
+    conn->add_task();
 }
 
@@ -13,19 +13,29 @@ class TcpServer;
 class Acceptor
 {
 public:
-    Acceptor(TcpServer* server, EventLoop* loop, const char *ip, uint16_t port);
+    ///reuse_port为true时监听socket设置SO_REUSEPORT，接受的连接直接由本loop处理。
+    ///incoming_cpu不小于0时设置SO_INCOMING_CPU，内核优先把该cpu收到的连接交给这个监听socket
+    Acceptor(TcpServer* server, EventLoop* loop, const char *ip, uint16_t port, bool reuse_port = false, int incoming_cpu = -1);
     ~Acceptor();
 
   bool is_listenning() const { return ac_listening; }
+  ///所属loop是io_uring后端时用多次触发的accept，否则等待可读事件后循环accept。
+  ///io_uring模式下要在所属loop停止之后再销毁acceptor
   void listen();
 
  private:
     void do_accept();
+    ///io_uring的accept完成回调，res是新连接的fd或-errno
+    void on_accept(int res);
+    ///进程fd用完时，用预留的fd接受并关闭一个连接，避免监听socket一直可读
+    void drop_one_connection();
+    void new_connection(int connfd, struct sockaddr_in& conn_addr, socklen_t& conn_addrlen);
 
     TcpServer *ac_server;
     int ac_listen_fd;
     EventLoop *ac_loop;
     bool ac_listening;
+    bool ac_reuse_port;
     int ac_idle_fd;
     sockaddr_in ac_server_addr;
 };
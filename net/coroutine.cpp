@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "coroutine.h"
+#include "tcp_conn.h"
+#include "event_loop.h"
+
+using namespace std;
+
+namespace {
+
+struct FreeFrame {
+    FreeFrame *next;
+};
+
+/// 本线程各规格的空闲帧链表，线程退出时释放
+struct FrameCache {
+    FreeFrame *fc_list[FramePool::CLASS_NUM] = {};
+    int fc_cnt[FramePool::CLASS_NUM] = {};
+    size_t fc_reuse{ 0 };
+    size_t fc_alloc{ 0 };
+
+    ~FrameCache() {
+        for (int i = 0; i < FramePool::CLASS_NUM; i++) {
+            while (fc_list[i] != nullptr) {
+                FreeFrame *f = fc_list[i];
+                fc_list[i] = f->next;
+                ::operator delete(f);
+            }
+        }
+    }
+};
+
+FrameCache& local_frames()
+{
+    static thread_local FrameCache cache;
+    return cache;
+}
+
+/// 128, 256, ... 4096，返回-1表示超过最大规格
+int frame_class(size_t size)
+{
+    if (size > FramePool::MAX_FRAME_SIZE) {
+        return -1;
+    }
+    if (size <= FramePool::MIN_FRAME_SIZE) {
+        return 0;
+    }
+    return 64 - __builtin_clzll(size - 1) - 7;
+}
+
+}
+
+void *FramePool::alloc(size_t size)
+{
+    int index = frame_class(size);
+    if (index < 0) {
+        return ::operator new(size);
+    }
+    FrameCache& cache = local_frames();
+    if (FreeFrame *f = cache.fc_list[index]; f != nullptr) {
+        cache.fc_list[index] = f->next;
+        cache.fc_cnt[index]--;
+        cache.fc_reuse++;
+        return f;
+    }
+    cache.fc_alloc++;
+    return ::operator new(MIN_FRAME_SIZE << index);
+}
+
+void FramePool::free(void *p, size_t size)
+{
+    int index = frame_class(size);
+    FrameCache& cache = local_frames();
+    if (index < 0 || cache.fc_cnt[index] >= MAX_FREE_NUM) {
+        ::operator delete(p);
+        return;
+    }
+    FreeFrame *f = static_cast<FreeFrame*>(p);
+    f->next = cache.fc_list[index];
+    cache.fc_list[index] = f;
+    cache.fc_cnt[index]++;
+}
+
+size_t FramePool::reuse_count()
+{
+    return local_frames().fc_reuse;
+}
+
+size_t FramePool::alloc_count()
+{
+    return local_frames().fc_alloc;
+}
+
+bool ReadUntilAwaiter::await_ready()
+{
+    return ra_conn->is_closed() || ra_conn->find_read_delim(ra_delim) > 0;
+}
+
+void ReadUntilAwaiter::await_suspend(coroutine_handle<> h)
+{
+    ra_conn->wait_read(h, ra_delim);
+}
+
+size_t ReadUntilAwaiter::await_resume()
+{
+    return ra_conn->is_closed() ? 0 : ra_conn->tc_read_found;
+}
+
+bool WriteAwaiter::await_ready()
+{
+    return wa_conn->is_closed() || wa_conn->tc_obuf.length() <= WRITE_WAIT_BYTES;
+}
+
+void WriteAwaiter::await_suspend(coroutine_handle<> h)
+{
+    wa_conn->wait_write(h);
+}
+
+bool WriteAwaiter::await_resume()
+{
+    return !wa_conn->is_closed();
+}
+
+void SleepAwaiter::await_suspend(coroutine_handle<> h)
+{
+    //恢复后协程可能执行完并释放栈帧，节点也随之析构，时间轮在回调之后不再访问节点
+    sa_node.tn_callback = [h]() { h.resume(); };
+    sa_loop->add_timer(&sa_node, sa_ms);
+}
@@ -0,0 +1,98 @@
+#ifndef __COROUTINE_H__
+#define __COROUTINE_H__
+
+#include <stddef.h>
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <string_view>
+
+#include "../timer/timing_wheel.h"
+#include "../memory/shared_buf.h"
+
+using namespace std;
+
+class EventLoop;
+class TcpConnection;
+
+/// 协程栈帧池。每个线程一份，一个EventLoop独占一个线程，相当于每个loop一个池，不加锁。
+/// 帧大小向上取整到2的幂（最小128字节），释放的帧挂在对应规格的空闲链表上复用，
+/// 超过MAX_FRAME_SIZE的帧直接使用operator new
+class FramePool {
+public:
+    static const size_t MIN_FRAME_SIZE = 128;
+    static const size_t MAX_FRAME_SIZE = 4096;
+    static const int CLASS_NUM = 6;
+    static const int MAX_FREE_NUM = 1024;   /// 每个规格最多缓存的空闲帧数
+
+    static void *alloc(size_t size);
+    static void free(void *p, size_t size);
+
+    /// 本线程从池中复用帧的次数和新分配的次数
+    static size_t reuse_count();
+    static size_t alloc_count();
+};
+
+/// 连接处理协程的返回类型。协程创建后立即执行到第一个co_await，结束时自动释放栈帧，
+/// 不需要调用者持有。协程只能在连接所属的loop线程中执行和恢复。
+/// 处理函数的参数要按值传递TcpConnSP，参数保存在栈帧中，保证协程执行期间连接不会析构
+struct CoTask {
+    struct promise_type {
+        CoTask get_return_object() { return CoTask{}; }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+
+        static void *operator new(size_t size) { return FramePool::alloc(size); }
+        static void operator delete(void *p, size_t size) { FramePool::free(p, size); }
+    };
+};
+
+/// co_await conn->read_until(delim)：等到输入缓冲区中出现delim，
+/// 返回包括delim在内的字节数，数据仍在输入缓冲区中由调用者pop；连接关闭返回0
+class ReadUntilAwaiter {
+public:
+    ReadUntilAwaiter(TcpConnection *conn, string_view delim) : ra_conn(conn), ra_delim(delim) {}
+
+    bool await_ready();
+    void await_suspend(coroutine_handle<> h);
+    size_t await_resume();
+
+private:
+    TcpConnection *ra_conn;
+    string_view ra_delim;
+};
+
+/// co_await conn->write(...)：数据写入输出缓冲区，积压不超过WRITE_WAIT_BYTES时不挂起，
+/// 否则等到输出全部写入内核再恢复。连接已经关闭返回false
+class WriteAwaiter {
+public:
+    static const int WRITE_WAIT_BYTES = 64 * 1024;
+
+    explicit WriteAwaiter(TcpConnection *conn) : wa_conn(conn) {}
+
+    bool await_ready();
+    void await_suspend(coroutine_handle<> h);
+    bool await_resume();
+
+private:
+    TcpConnection *wa_conn;
+};
+
+/// co_await loop->sleep(ms)：定时器节点放在协程栈帧中，挂到loop的时间轮上，不分配内存
+class SleepAwaiter {
+public:
+    SleepAwaiter(EventLoop *loop, int ms) : sa_loop(loop), sa_ms(ms) {}
+
+    bool await_ready() const { return sa_ms <= 0; }
+    void await_suspend(coroutine_handle<> h);
+    void await_resume() const {}
+
+private:
+    EventLoop *sa_loop;
+    int sa_ms;
+    TimingWheel::Node sa_node;
+};
+
+#endif
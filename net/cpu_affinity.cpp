@@ -0,0 +1,49 @@
+#include <sched.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "cpu_affinity.h"
+#include "../log/pr.h"
+
+bool bind_thread_to_cpu(int cpu)
+{
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (int ret = pthread_setaffinity_np(pthread_self(), sizeof set, &set); ret != 0) {
+        PR_ERROR("bind thread to cpu %d failed, error str:%s\n", cpu, strerror(ret));
+        return false;
+    }
+    return true;
+}
+
+int cpu_numa_node(int cpu)
+{
+    //sysfs中cpu目录下有指向所属节点的nodeN链接
+    char path[64];
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == nullptr) {
+        return 0;
+    }
+    int node = 0;
+    while (struct dirent *entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+int current_cpu()
+{
+    return sched_getcpu();
+}
@@ -0,0 +1,13 @@
+#ifndef __CPU_AFFINITY_H__
+#define __CPU_AFFINITY_H__
+
+/// 把调用线程绑定到一个cpu上，成功返回true
+bool bind_thread_to_cpu(int cpu);
+
+/// cpu所在的NUMA节点，没有NUMA信息时返回0
+int cpu_numa_node(int cpu);
+
+/// 调用线程当前运行的cpu
+int current_cpu();
+
+#endif
@@ -2,53 +2,44 @@
 #define __EPOLL_H__
 
 #include <sys/epoll.h>
-#include <functional>
-#include <unordered_map>
-#include <set>
 #include <vector>
 
+#include "poller.h"
+
 using namespace std;
 
-class Epoll {
+///epoll后端，epoll_event.data中保存fd和槽的gen
+class Epoll : public Poller {
 public:
-    
-    typedef function<void()> EventCallback;
-
-    struct io_event 
-    {
-        int event;
-        EventCallback read_callback;
-        EventCallback write_callback;
-    };
-
     Epoll();
 
     ~Epoll();
 
-    void epoll_add(int fd, int event, const EventCallback& cb);
-
-    void epoll_del(int fd, int event);
+    PollerType type() const override { return PollerType::Epoll; }
 
-    void epoll_del(int fd);
-
-    int poll();
+    ///timeout_ms小于0时使用默认的等待时间，等待之前先提交积累的事件修改
+    int poll(int timeout_ms = -1) override;
 
     int get_epoll_fd() { return ep_epoll_fd; }
 
-    void get_listen_fds(set<int> &fd_set) {
-        fd_set = ep_listen_fds;
+protected:
+    bool commit(io_event *ev) override;
+    void remove(io_event *ev) override;
+
+    ///按就绪事件data中的fd取槽，gen不同说明fd在本轮分发中已经被删除，返回nullptr
+    io_event* ready_slot(const epoll_event& ee) const {
+        io_event *ev = find_slot(static_cast<int>(static_cast<uint32_t>(ee.data.u64)));
+        return ev != nullptr && ev->gen == static_cast<uint32_t>(ee.data.u64 >> 32) ? ev : nullptr;
     }
 
  private:
+    static uint64_t make_data(int fd, uint32_t gen) {
+        return (uint64_t)gen << 32 | (uint32_t)fd;
+    }
     void execute_cbs(int event_count);
 
-    static const int MAXFDS = 100000;
     int ep_epoll_fd;
-    set<int> ep_listen_fds;//监听的fd的集合
-
-    typedef unordered_map<int, io_event>::iterator ep_event_map_iter;//ep_event_map的迭代器//
-    unordered_map<int, io_event> ep_event_map;//fd和事件的映射
     vector<epoll_event> ep_events;//事件集合
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -3,14 +3,31 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <assert.h>
 
 #include "event_loop.h"
+#include "epoll.h"
+#include "tcp_conn.h"
 #include "../log/pr.h"
 #include "../log/log.h"
 
 using namespace std;
 
-EventLoop::EventLoop() : el_epoller(new Epoll()) {
+const int MAX_TASKS_PER_LOOP = 1024;
+
+EventLoop::EventLoop(PollerType type) {
+    if (type == PollerType::IoUring) {
+        if (unique_ptr<IoUring> ring = IoUring::create(); ring) {
+            el_uring = ring.get();
+            el_poller = move(ring);
+        }
+        else {
+            PR_WARN("io_uring not supported, use epoll\n");
+        }
+    }
+    if (!el_poller) {
+        el_poller = make_unique<Epoll>();
+    }
     //创建一个event_fd,用于唤醒epoll_wait,并且设置为非阻塞 
     if(el_evfd = { eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) }; el_evfd < 0)
     {
@@ -18,7 +35,7 @@ EventLoop::EventLoop() : el_epoller(new Epoll()) {
         exit(1);
     }
     LOG_INFO("create one eventloop, event fd is %d\n", el_evfd);
-    el_epoller->epoll_add(el_evfd, EPOLLIN , [this](){ this->evfd_read(); });
+    el_poller->add(el_evfd, EPOLLIN , [this](){ this->evfd_read(); });
 }
 
 EventLoop::~EventLoop() {
@@ -44,41 +61,87 @@ void EventLoop::evfd_read() {
 }
 //添加一个任务到任务队列中
 void EventLoop::add_task(Task&& cb) {
-    LOG_INFO("eventloop, add one task\n");
+    LOG_DEBUG("eventloop, add one task\n");
     if (is_in_loop_thread())
     {
         cb();
+        return;
     }
-    else
-    {
-        lock_guard<mutex> lock(el_mutex);
-        el_task_funcs.emplace_back(move(cb));       
+    queue_task(move(cb));
+}
+//放入任务队列，loop线程自己投递时不需要唤醒
+void EventLoop::queue_task(Task&& cb) {
+    el_tasks.push(move(cb));
+    if (is_in_loop_thread()) {
+        return;
+    }
+    //与loop中先置el_polling再检查队列配对：要么loop看到这个任务不阻塞，要么这里看到loop将要阻塞
+    atomic_thread_fence(memory_order_seq_cst);
+    if (el_polling.exchange(false)) {
+        evfd_wakeup();
     }
-
-    if (!is_in_loop_thread() || el_dealing_task_funcs) { evfd_wakeup(); }
 }
 // 事件循环主体，不断调用epoll_wait等待事件发生，然后处理事件
 void EventLoop::loop() {
+    //loop可能在创建它之外的线程中运行，以实际执行loop的线程作为所属线程
+    el_tid.store(this_thread::get_id());
     el_quit = false;
     while (!el_quit) {
-        auto cnt = el_epoller->poll();
-        LOG_INFO("eventloop, tid %lld, loop once, epoll event cnt %d\n", tid_to_ll(this_thread::get_id()), cnt);
+        int timeout = el_wheel.next_timeout_ms();
+        el_polling.store(true);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!el_tasks.empty()) {
+            //已经有任务，不阻塞
+            timeout = 0;
+        }
+        auto cnt = el_poller->poll(timeout);
+        el_polling.store(false, memory_order_relaxed);
+        //只有loop线程写，不需要原子的自增
+        el_wakeup_cnt.store(el_wakeup_cnt.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        LOG_DEBUG("eventloop, tid %lld, loop once, epoll event cnt %d\n", tid_to_ll(this_thread::get_id()), cnt);
+        el_wheel.advance();
         execute_task_funcs();
     }
 }
-//执行任务队列中的任务
+//添加一次性定时器，不在loop线程中时转交给loop线程
+void EventLoop::run_after(int ms, TimingWheel::Callback&& cb) {
+    if (is_in_loop_thread()) {
+        el_wheel.run_after(ms, move(cb));
+        return;
+    }
+    add_task([this, ms, cb = move(cb)]() mutable { el_wheel.run_after(ms, move(cb)); });
+}
+//执行任务队列中的任务，每次最多执行MAX_TASKS_PER_LOOP个，其他线程持续投递时也能及时处理io事件，
+//剩下的任务使下一次epoll_wait不阻塞
 void EventLoop::execute_task_funcs() {
-    std::vector<Task> functors;
-    el_dealing_task_funcs = true;
+    Task task;
+    for (int i = 0; i < MAX_TASKS_PER_LOOP && el_tasks.pop(task); i++) {
+        task();
+        task.reset();
+    }
+}
 
-    {
-        lock_guard<mutex> lock(el_mutex);
-        //swap函数交换两个vector的元素，这样可以减少锁的持有时间
-        functors.swap(el_task_funcs);
+//注册连接，记录连接在el_conns中的下标
+void EventLoop::add_conn(const shared_ptr<TcpConnection>& conn) {
+    assert(is_in_loop_thread());
+    conn->set_loop_index(el_conns.size());
+    el_conns.emplace_back(conn);
+    el_conn_cnt.store(el_conns.size(), memory_order_relaxed);
+}
+//删除连接，把最后一个连接移到被删除的位置
+void EventLoop::remove_conn(const shared_ptr<TcpConnection>& conn) {
+    assert(is_in_loop_thread());
+    int index = conn->get_loop_index();
+    if (index < 0 || index >= (int)el_conns.size() || el_conns[index] != conn) {
+        return;
+    }
+    if (index != (int)el_conns.size() - 1) {
+        el_conns[index] = move(el_conns.back());
+        el_conns[index]->set_loop_index(index);
     }
-    //执行任务
-    for (size_t i = 0; i < functors.size(); ++i) functors[i]();
-    el_dealing_task_funcs = false;
+    el_conns.pop_back();
+    conn->set_loop_index(-1);
+    el_conn_cnt.store(el_conns.size(), memory_order_relaxed);
 }
 
 void EventLoop::quit() {
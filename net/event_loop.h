@@ -4,51 +4,124 @@
 #include <functional>
 #include <memory>
 #include <vector>
-#include <mutex>
 #include <thread>
+#include <atomic>
 #include <sys/eventfd.h>
 
-#include "epoll.h"
+#include "poller.h"
+#include "io_uring_poller.h"
+#include "task_queue.h"
+#include "file_cache.h"
+#include "coroutine.h"
+#include "../timer/timing_wheel.h"
 
 using namespace std;
 
+class TcpConnection;
+
 class EventLoop {
 public:
-    typedef std::function<void()> Task;
+    ///投递到loop的任务，只捕获少量数据的lambda不分配内存
+    typedef SmallTask Task;
 
-    EventLoop();
+    ///type为IoUring而内核不支持时退回epoll
+    explicit EventLoop(PollerType type = PollerType::Epoll);
 
     ~EventLoop();
 
     void loop();
     void quit();
 
+    ///在loop线程中直接执行，其他线程中放入无锁队列，只有loop阻塞在epoll_wait中时才写eventfd唤醒
     void add_task(Task&& cb);
+    ///总是放入任务队列，在loop线程中调用时任务在下一轮循环中执行，本轮epoll_wait不阻塞
+    void queue_task(Task&& cb);
 
-    void add_to_poller(int fd, int event, const Epoll::EventCallback& cb) {
-        el_epoller->epoll_add(fd, event, cb);
+    void add_to_poller(int fd, int event, const Poller::EventCallback& cb) {
+        el_poller->add(fd, event, cb);
     }
 
     void del_from_poller(int fd, int event) {
-        el_epoller->epoll_del(fd, event);
+        el_poller->del(fd, event);
     }
 
     void del_from_poller(int fd) {
-        el_epoller->epoll_del(fd);
+        el_poller->del(fd);
     }
 
-    bool is_in_loop_thread() const { return el_tid == this_thread::get_id(); }
+    PollerType poller_type() const { return el_poller->type(); }
+    ///io_uring后端的完成模式接口，epoll后端返回nullptr
+    IoUring* get_uring() const { return el_uring; }
+
+    ///定时器只能在loop线程中使用，节点已经在时间轮中时相当于刷新超时时间
+    void add_timer(TimingWheel::Node *node, int ms) { el_wheel.add(node, ms); }
+    void cancel_timer(TimingWheel::Node *node) { el_wheel.cancel(node); }
+    ///一次性定时器，可以在任意线程中调用，回调在loop线程中执行
+    void run_after(int ms, TimingWheel::Callback&& cb);
+    ///在本loop的协程中co_await，ms毫秒后由时间轮恢复
+    SleepAwaiter sleep(int ms) { return SleepAwaiter(this, ms); }
+
+    bool is_in_loop_thread() const { return el_tid.load() == this_thread::get_id(); }
+
+    ///本loop的连接注册表，只能在loop线程中调用，增删都是O(1)
+    void add_conn(const shared_ptr<TcpConnection>& conn);
+    void remove_conn(const shared_ptr<TcpConnection>& conn);
+
+    ///loop从poll返回的次数，可以在任意线程中读取
+    uint64_t wakeup_count() const { return el_wakeup_cnt.load(memory_order_relaxed); }
+
+    ///可以在任意线程中读取
+    int conn_count() const { return el_conn_cnt.load(memory_order_relaxed); }
+
+    ///负载计数，可以在任意线程中读取，供选择子loop的负载均衡策略使用。
+    ///load_conns包括已经分配给本loop、还没有在loop线程中注册的连接，连续接受的连接能看到前一个的分配
+    int load_conns() const {
+        return el_conn_cnt.load(memory_order_relaxed) + el_incoming_cnt.load(memory_order_relaxed);
+    }
+    ///本loop所有连接的输入、输出缓冲区中积压的字节数
+    int64_t pending_bytes() const { return el_pending_bytes.load(memory_order_relaxed); }
+    ///连接分配给本loop时加1，在loop线程中注册时减1
+    void add_incoming_conn(int delta) { el_incoming_cnt.fetch_add(delta, memory_order_relaxed); }
+    ///只在loop线程中调用
+    void add_pending_bytes(int64_t delta) {
+        el_pending_bytes.store(el_pending_bytes.load(memory_order_relaxed) + delta, memory_order_relaxed);
+    }
+
+    ///本loop的打开文件缓存，只能在loop线程中调用
+    FileCache& get_file_cache() { return el_file_cache; }
+
+    ///只能在loop线程中调用
+    template <typename F>
+    void for_each_conn(F&& f) {
+        for (auto& conn : el_conns) {
+            f(conn);
+        }
+    }
 
 private:
-    shared_ptr<Epoll> el_epoller;
-    bool el_quit{ false };
+    unique_ptr<Poller> el_poller;
+    IoUring *el_uring{ nullptr };
+    atomic<bool> el_quit{ false };
+    atomic<uint64_t> el_wakeup_cnt{ 0 };
     
-    const thread::id el_tid{ this_thread::get_id() };
-    mutex el_mutex;
+    atomic<thread::id> el_tid;//执行loop的线程，loop开始之前为空，所有add_task都进入任务队列
 
     int el_evfd;
-    std::vector<Task> el_task_funcs;
-    bool el_dealing_task_funcs{ false };
+    TaskQueue el_tasks;//其他线程投递的任务
+    ///loop即将或正在阻塞在epoll_wait中。生产者用exchange把它置为false，多个生产者只有一个写eventfd
+    atomic<bool> el_polling{ false };
+
+    ///连接紧凑地存放在vector中，连接记录自己的下标，删除时把最后一个元素移到空位
+    vector<shared_ptr<TcpConnection>> el_conns;
+    atomic<int> el_conn_cnt{ 0 };
+    atomic<int> el_incoming_cnt{ 0 };
+    atomic<int64_t> el_pending_bytes{ 0 };
+
+    ///本loop的时间轮，epoll_wait的超时时间由最近的定时器决定。
+    ///声明在el_conns之后，析构时先于连接析构，摘除连接中的定时器节点
+    TimingWheel el_wheel;
+
+    FileCache el_file_cache;
 
     void evfd_wakeup();
     void evfd_read();
@@ -0,0 +1,64 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "file_cache.h"
+#include "../log/log.h"
+
+using namespace std;
+
+OpenFile::~OpenFile()
+{
+    close(of_fd);
+}
+
+OpenFileSP FileCache::open_file(const string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_INFO("open file %s failed\n", path.c_str());
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+    return make_shared<OpenFile>(fd, st.st_size, st.st_mtime);
+}
+
+OpenFileSP FileCache::get(const string& path)
+{
+    auto now = Clock::now();
+    if (auto it = fc_index.find(path); it != fc_index.end()) {
+        Entry& entry = *it->second;
+        bool valid = true;
+        if (now - entry.checked >= chrono::milliseconds(FILE_CHECK_MS)) {
+            //文件被替换、修改或删除之后缓存的fd已经过期
+            struct stat st;
+            valid = stat(path.c_str(), &st) == 0 && st.st_size == entry.file->of_size
+                    && st.st_mtime == entry.file->of_mtime;
+            entry.checked = now;
+        }
+        if (valid) {
+            fc_hits++;
+            fc_lru.splice(fc_lru.begin(), fc_lru, it->second);
+            return entry.file;
+        }
+        fc_lru.erase(it->second);
+        fc_index.erase(it);
+    }
+
+    fc_misses++;
+    OpenFileSP file = open_file(path);
+    if (!file) {
+        return nullptr;
+    }
+    fc_lru.push_front(Entry{ path, file, now });
+    fc_index[path] = fc_lru.begin();
+    if (fc_lru.size() > fc_capacity) {
+        fc_index.erase(fc_lru.back().path);
+        fc_lru.pop_back();
+    }
+    return file;
+}
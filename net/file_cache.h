@@ -0,0 +1,68 @@
+#ifndef __FILE_CACHE_H__
+#define __FILE_CACHE_H__
+
+#include <sys/types.h>
+#include <time.h>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+/// 打开的只读文件，最后一个引用释放时关闭fd。
+/// 正在发送的文件即使被缓存淘汰，fd也会保持打开直到发送完成
+struct OpenFile {
+    OpenFile(int fd, off_t size, time_t mtime) : of_fd(fd), of_size(size), of_mtime(mtime) {}
+    ~OpenFile();
+
+    OpenFile(const OpenFile&) = delete;
+    OpenFile& operator=(const OpenFile&) = delete;
+
+    int of_fd;
+    off_t of_size;
+    time_t of_mtime;
+};
+
+typedef shared_ptr<OpenFile> OpenFileSP;
+
+/// 以路径为key的LRU缓存，保存打开的fd和stat结果，热点文件不需要每次open和stat。
+/// 每个EventLoop一个，只在loop线程中访问，不加锁。
+/// 缓存项超过FILE_CHECK_MS没有校验时重新stat，文件被修改或删除后重新打开
+class FileCache {
+public:
+    static constexpr int FILE_CHECK_MS = 1000;
+
+    explicit FileCache(size_t capacity = 256) : fc_capacity(capacity) {}
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    /// 返回打开的普通文件，不存在或不是普通文件时返回nullptr
+    OpenFileSP get(const string& path);
+
+    /// 命中和未命中的次数，用于统计
+    uint64_t hit_count() const { return fc_hits; }
+    uint64_t miss_count() const { return fc_misses; }
+    size_t size() const { return fc_lru.size(); }
+
+private:
+    typedef chrono::steady_clock Clock;
+
+    struct Entry {
+        string path;
+        OpenFileSP file;
+        Clock::time_point checked;
+    };
+
+    static OpenFileSP open_file(const string& path);
+
+    size_t fc_capacity;
+    list<Entry> fc_lru;     /// 头部是最近使用的
+    unordered_map<string, list<Entry>::iterator> fc_index;
+    uint64_t fc_hits{ 0 };
+    uint64_t fc_misses{ 0 };
+};
+
+#endif
@@ -0,0 +1,500 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+#include "io_uring_poller.h"
+#include "../memory/mem_pool.h"
+#include "../log/log.h"
+
+using namespace std;
+
+const int URING_WAIT_TIME = 20000;
+///一次poll中提交回调产生的请求的最多轮数
+const int MAX_FLUSH_ROUNDS = 4;
+const uint16_t RECV_BUF_GROUP = 0;
+
+///user_data的低3位是请求类型，send是SendOp的地址，其他是fd和gen
+enum {
+    UD_POLL = 1,
+    UD_ACCEPT = 2,
+    UD_RECV = 3,
+    UD_SEND = 4,
+    UD_IGNORE = 5,
+};
+const uint32_t GEN_MASK = (1U << 29) - 1;
+
+static inline uint64_t make_ud(int kind, int fd, uint32_t gen) {
+    return (uint64_t)(uint32_t)fd << 32 | (uint64_t)(gen & GEN_MASK) << 3 | kind;
+}
+
+unique_ptr<IoUring> IoUring::create(unsigned entries) {
+    unique_ptr<IoUring> ring(new IoUring());
+    if (!ring->init(entries)) {
+        return nullptr;
+    }
+    return ring;
+}
+//创建ring并映射队列，需要的特性不支持时返回false
+bool IoUring::init(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = entries * 4;
+    ur_ring_fd = syscall(SYS_io_uring_setup, entries, &p);
+    if (ur_ring_fd < 0 && errno == EINVAL) {
+        //COOP_TASKRUN需要5.19
+        p.flags = IORING_SETUP_CQSIZE;
+        ur_ring_fd = syscall(SYS_io_uring_setup, entries, &p);
+    }
+    if (ur_ring_fd < 0) {
+        PR_WARN("io_uring setup failed, error str:%s\n", strerror(errno));
+        return false;
+    }
+    unsigned need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((p.features & need) != need) {
+        PR_WARN("io_uring features 0x%x not supported\n", p.features);
+        return false;
+    }
+    if (!probe_ops()) {
+        return false;
+    }
+
+    ur_ring_size = max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+    void *ptr = mmap(nullptr, ur_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur_ring_fd, IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    ur_ring_ptr = ptr;
+    ur_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ptr = mmap(nullptr, ur_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur_ring_fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    ur_sqes = static_cast<struct io_uring_sqe*>(ptr);
+
+    char *base = static_cast<char*>(ur_ring_ptr);
+    ur_sq_head_ptr = reinterpret_cast<unsigned*>(base + p.sq_off.head);
+    ur_sq_tail_ptr = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+    ur_sq_mask = *reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+    ur_sq_entries = p.sq_entries;
+    ur_sq_tail = *ur_sq_tail_ptr;
+    //提交队列的下标数组固定为sqe的下标
+    unsigned *array = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) {
+        array[i] = i;
+    }
+    ur_cq_head_ptr = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+    ur_cq_tail_ptr = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+    ur_cq_mask = *reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+    ur_cqes = reinterpret_cast<struct io_uring_cqe*>(base + p.cq_off.cqes);
+    return true;
+}
+
+//操作码用IORING_REGISTER_PROBE确认；请求的标志位无法探测，不支持时内核返回-EINVAL，按内核版本确认：
+//IORING_ACCEPT_MULTISHOT和IORING_ASYNC_CANCEL_FD|ALL需要5.19，IORING_RECV_MULTISHOT需要6.0
+bool IoUring::probe_ops() {
+    static const uint8_t ops[] = {
+        IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE, IORING_OP_ACCEPT, IORING_OP_RECV,
+        IORING_OP_SENDMSG, IORING_OP_ASYNC_CANCEL, IORING_OP_PROVIDE_BUFFERS,
+    };
+    vector<char> buf(sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe*>(buf.data());
+    if (syscall(SYS_io_uring_register, ur_ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) {
+        PR_WARN("io_uring probe failed, error str:%s\n", strerror(errno));
+        return false;
+    }
+    for (uint8_t op : ops) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            PR_WARN("io_uring opcode %d not supported\n", op);
+            return false;
+        }
+    }
+
+    struct utsname name;
+    int major = 0, minor = 0;
+    if (uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2) {
+        PR_WARN("unknown kernel version, multishot recv may not be supported\n");
+        return false;
+    }
+    if (major < 6) {
+        PR_WARN("kernel %s does not support multishot recv (needs 6.0)\n", name.release);
+        return false;
+    }
+    return true;
+}
+
+IoUring::~IoUring() {
+    if (ur_ring_fd >= 0) {
+        close(ur_ring_fd);
+    }
+    if (ur_ring_ptr != nullptr) {
+        munmap(ur_ring_ptr, ur_ring_size);
+    }
+    if (ur_sqes != nullptr) {
+        munmap(ur_sqes, ur_sqes_size);
+    }
+    for (Chunk *chunk : ur_buf_chunks) {
+        if (chunk != nullptr) {
+            Mempool::get_instance().retrieve(chunk);
+        }
+    }
+}
+//取得一个空的sqe，提交队列满时先提交
+struct io_uring_sqe* IoUring::get_sqe() {
+    if (ur_sq_tail - __atomic_load_n(ur_sq_head_ptr, __ATOMIC_ACQUIRE) == ur_sq_entries) {
+        enter(0, 0);
+    }
+    assert(ur_sq_tail - __atomic_load_n(ur_sq_head_ptr, __ATOMIC_ACQUIRE) < ur_sq_entries);
+    struct io_uring_sqe *sqe = &ur_sqes[ur_sq_tail & ur_sq_mask];
+    memset(sqe, 0, sizeof *sqe);
+    ur_sq_tail++;
+    return sqe;
+}
+//提交队列中的所有请求，同时处理内核中积压的完成工作，wait_nr大于0时等待完成事件
+int IoUring::enter(unsigned wait_nr, int timeout_ms) {
+    __atomic_store_n(ur_sq_tail_ptr, ur_sq_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = ur_sq_tail - __atomic_load_n(ur_sq_head_ptr, __ATOMIC_ACQUIRE);
+
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof arg);
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    ur_enter_cnt++;
+    int ret = syscall(SYS_io_uring_enter, ur_ring_fd, to_submit, wait_nr,
+                        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        PR_ERROR("io_uring enter error, error no:%d, error str:%s\n", errno, strerror(errno));
+    }
+    return ret;
+}
+//等待并处理完成事件
+int IoUring::poll(int timeout_ms) {
+    apply_changes();
+    begin_dispatch();
+    int cnt = reap();
+    if (cnt == 0) {
+        enter(timeout_ms == 0 ? 0 : 1, timeout_ms < 0 ? URING_WAIT_TIME : timeout_ms);
+        cnt = reap();
+    }
+    //回调中产生的send等请求马上提交，内联完成的结果在本次处理，不需要再唤醒一次
+    for (int i = 0; i < MAX_FLUSH_ROUNDS; i++) {
+        apply_changes();
+        if (!has_unsubmitted()) {
+            break;
+        }
+        enter(0, 0);
+        cnt += reap();
+    }
+    end_dispatch();
+    return cnt;
+}
+
+int IoUring::reap() {
+    int cnt = 0;
+    unsigned head = *ur_cq_head_ptr;
+    while (head != __atomic_load_n(ur_cq_tail_ptr, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &ur_cqes[head & ur_cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int res = cqe->res;
+        uint32_t flags = cqe->flags;
+        //先归还槽位，回调中可能提交新的请求
+        head++;
+        __atomic_store_n(ur_cq_head_ptr, head, __ATOMIC_RELEASE);
+        handle_cqe(user_data, res, flags);
+        cnt++;
+    }
+    return cnt;
+}
+
+IoUring::FdOps& IoUring::fd_ops(int fd) {
+    if ((size_t)fd >= ur_ops.size()) {
+        ur_ops.resize(max<size_t>(fd + 1, ur_ops.size() * 2));
+    }
+    return ur_ops[fd];
+}
+
+void IoUring::handle_cqe(uint64_t user_data, int res, uint32_t flags) {
+    int kind = user_data & 7;
+    if (kind == UD_SEND) {
+        SendOp *op = reinterpret_cast<SendOp*>(user_data & ~7ULL);
+        SendCallback cb = move(op->cb);
+        op->cb = nullptr;
+        ur_free_sends.push_back(op);
+        cb(res);
+        return;
+    }
+    if (kind == UD_IGNORE) {
+        return;
+    }
+    int fd = static_cast<int>(user_data >> 32);
+    uint32_t gen = (user_data >> 3) & GEN_MASK;
+    bool more = flags & IORING_CQE_F_MORE;
+
+    if (kind == UD_POLL) {
+        io_event *ev = find_slot(fd);
+        if (ev == nullptr || ev->event == 0 || (ev->gen & GEN_MASK) != gen) {
+            return;
+        }
+        if (res < 0) {
+            if (res != -ECANCELED) {
+                ev->kernel_event = 0;
+                dispatch(ev, EPOLLERR);
+            }
+            return;
+        }
+        if (!more) {
+            //内核结束了多次触发的poll，下一次提交时重新加入
+            ev->kernel_event = 0;
+            mark_changed(ev);
+        }
+        dispatch(ev, res);
+        return;
+    }
+
+    if (kind == UD_ACCEPT) {
+        FdOps& ops = fd_ops(fd);
+        if ((ops.gen & GEN_MASK) != gen || !ops.accept_cb) {
+            return;
+        }
+        AcceptCallback cb = move(ops.accept_cb);
+        cb(res);
+        FdOps& after = fd_ops(fd);
+        if ((after.gen & GEN_MASK) != gen) {
+            return;
+        }
+        if (!after.accept_cb) {
+            after.accept_cb = move(cb);
+        }
+        //出错或队列溢出后内核结束多次触发的accept，除了监听socket本身无效都重新提交
+        if (!more && res != -EINVAL && res != -EBADF && res != -ENOTSOCK) {
+            arm_accept(fd);
+        }
+        return;
+    }
+
+    //UD_RECV，数据在内核选择的chunk中，先给槽换上新的chunk
+    Chunk *chunk = nullptr;
+    if (flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = flags >> 16;
+        chunk = ur_buf_chunks[bid];
+        Chunk *fresh = Mempool::get_instance().alloc_chunk(RECV_BUF_SIZE);
+        if (fresh == nullptr) {
+            //内存池耗尽，丢弃这批数据，连接按出错处理
+            PR_ERROR("no free chunk for io_uring recv buffer\n");
+            provide_buf(chunk, bid);
+            chunk = nullptr;
+            res = -ENOMEM;
+        }
+        else {
+            provide_buf(fresh, bid);
+            chunk->head = 0;
+            chunk->length = res;
+            chunk->next = nullptr;
+        }
+    }
+    FdOps& ops = fd_ops(fd);
+    if ((ops.gen & GEN_MASK) != gen || !ops.recv_cb) {
+        if (chunk != nullptr) {
+            Mempool::get_instance().retrieve(chunk);
+        }
+        return;
+    }
+    if (!more) {
+        ops.recv_armed = false;
+    }
+    if (res == -ENOBUFS || res == -ECANCELED) {
+        //缓冲区暂时用完，其他完成事件换上的新缓冲区在重新提交的请求之前提供；
+        //或者被pause_recv取消，取消完成前又恢复了
+        if (!ops.recv_paused) {
+            arm_recv(fd);
+        }
+        return;
+    }
+    RecvCallback cb = move(ops.recv_cb);
+    cb(res, chunk);
+    FdOps& after = fd_ops(fd);
+    if ((after.gen & GEN_MASK) != gen) {
+        return;
+    }
+    if (res <= 0) {
+        //对端关闭或出错，不会再有数据
+        after.active = false;
+        return;
+    }
+    if (!after.recv_cb) {
+        after.recv_cb = move(cb);
+    }
+    if (!more && !after.recv_armed && !after.recv_paused) {
+        arm_recv(fd);
+    }
+}
+
+//和其他请求一起提交，提交队列按顺序执行，之后的recv可以选到这个缓冲区
+void IoUring::provide_buf(Chunk *chunk, uint16_t bid) {
+    ur_buf_chunks[bid] = chunk;
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = reinterpret_cast<uint64_t>(chunk->data);
+    sqe->len = chunk->capacity;
+    sqe->buf_group = RECV_BUF_GROUP;
+    sqe->off = bid;
+    sqe->user_data = make_ud(UD_IGNORE, 0, 0);
+}
+
+void IoUring::arm_accept(int fd) {
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = make_ud(UD_ACCEPT, fd, fd_ops(fd).gen);
+}
+
+void IoUring::arm_recv(int fd) {
+    //接收缓冲区在loop线程中第一次使用时才从内存池分配，chunk在本线程所在的节点上
+    if (!ur_buf_filled) {
+        ur_buf_filled = true;
+        for (int bid = 0; bid < RECV_BUF_NUM; bid++) {
+            Chunk *chunk = Mempool::get_instance().alloc_chunk(RECV_BUF_SIZE);
+            if (chunk == nullptr) {
+                //内存池耗尽，用已经提供的缓冲区接收
+                PR_ERROR("no free chunk for io_uring recv buffer\n");
+                break;
+            }
+            provide_buf(chunk, bid);
+        }
+    }
+    fd_ops(fd).recv_armed = true;
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUF_GROUP;
+    sqe->user_data = make_ud(UD_RECV, fd, fd_ops(fd).gen);
+}
+
+void IoUring::accept_multishot(int listen_fd, const AcceptCallback& cb) {
+    FdOps& ops = fd_ops(listen_fd);
+    ops.accept_cb = cb;
+    ops.active = true;
+    arm_accept(listen_fd);
+}
+
+void IoUring::recv_multishot(int fd, const RecvCallback& cb) {
+    FdOps& ops = fd_ops(fd);
+    ops.recv_cb = cb;
+    ops.active = true;
+    ops.recv_paused = false;
+    arm_recv(fd);
+}
+//只取消recv请求，和其他请求一起提交；同一个fd上的send不受影响
+void IoUring::pause_recv(int fd) {
+    FdOps& ops = fd_ops(fd);
+    if (!ops.active || ops.recv_paused) {
+        return;
+    }
+    ops.recv_paused = true;
+    if (ops.recv_armed) {
+        struct io_uring_sqe *sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = make_ud(UD_RECV, fd, ops.gen);
+        sqe->user_data = make_ud(UD_IGNORE, fd, 0);
+    }
+}
+
+void IoUring::resume_recv(int fd) {
+    FdOps& ops = fd_ops(fd);
+    if (!ops.active || !ops.recv_paused) {
+        return;
+    }
+    ops.recv_paused = false;
+    //还没取消完成时，在取消的完成事件中重新提交
+    if (!ops.recv_armed && ops.recv_cb) {
+        arm_recv(fd);
+    }
+}
+
+void IoUring::send(int fd, const struct iovec *iov, int cnt, const SendCallback& cb) {
+    assert(cnt > 0 && cnt <= MAX_SEND_IOV);
+    SendOp *op;
+    if (ur_free_sends.empty()) {
+        ur_send_pool.emplace_back(make_unique<SendOp>());
+        op = ur_send_pool.back().get();
+    }
+    else {
+        op = ur_free_sends.back();
+        ur_free_sends.pop_back();
+    }
+    op->cb = cb;
+    memcpy(op->iov, iov, cnt * sizeof(struct iovec));
+    memset(&op->msg, 0, sizeof op->msg);
+    op->msg.msg_iov = op->iov;
+    op->msg.msg_iovlen = cnt;
+
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&op->msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<uint64_t>(op) | UD_SEND;
+}
+//取消fd上的所有请求，fd随后可能被关闭，立即提交
+void IoUring::cancel(int fd) {
+    if (fd < 0 || (size_t)fd >= ur_ops.size() || !ur_ops[fd].active) {
+        return;
+    }
+    FdOps& ops = ur_ops[fd];
+    ops.gen++;
+    ops.active = false;
+    ops.recv_armed = false;
+    ops.recv_paused = false;
+    ops.accept_cb = nullptr;
+    ops.recv_cb = nullptr;
+
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = make_ud(UD_IGNORE, fd, 0);
+    enter(0, 0);
+}
+//用多次触发的poll实现就绪事件，修改时删除旧的poll再加入新的，边缘触发
+bool IoUring::commit(io_event *ev) {
+    struct io_uring_sqe *sqe;
+    if (ev->kernel_event != 0) {
+        sqe = get_sqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->addr = make_ud(UD_POLL, ev->fd, ev->gen);
+        sqe->user_data = make_ud(UD_IGNORE, ev->fd, 0);
+    }
+    ev->gen++;
+    sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = ev->fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = ev->event & ~EPOLLET;
+    sqe->user_data = make_ud(UD_POLL, ev->fd, ev->gen);
+    return true;
+}
+//poll请求持有文件的引用，fd随后可能被关闭，立即提交删除
+void IoUring::remove(io_event *ev) {
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = make_ud(UD_POLL, ev->fd, ev->gen);
+    sqe->user_data = make_ud(UD_IGNORE, ev->fd, 0);
+    ev->gen++;
+    enter(0, 0);
+}
@@ -0,0 +1,127 @@
+#ifndef __IO_URING_POLLER_H__
+#define __IO_URING_POLLER_H__
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "poller.h"
+#include "../memory/chunk.h"
+
+using namespace std;
+
+///io_uring后端，直接使用系统调用，不依赖liburing。
+///fd的就绪事件用多次触发的poll请求实现，行为和epoll后端一致；另外提供完成模式的接口：
+///多次触发的accept，从内核选择缓冲区接收的多次触发recv，以及和下一次等待一起批量提交的send。
+///所有接口只能在loop线程中调用
+class IoUring : public Poller {
+public:
+    ///res不小于0时是新连接的fd，小于0时是-errno
+    typedef function<void(int res)> AcceptCallback;
+    ///res大于0时chunk中有res字节数据，chunk交给回调；res为0是对端关闭；小于0是-errno，之后不再回调
+    typedef function<void(int res, Chunk *chunk)> RecvCallback;
+    ///res是发送的字节数或-errno
+    typedef function<void(int res)> SendCallback;
+
+    ///接收缓冲区的个数和每个缓冲区的大小，缓冲区是内存池中的chunk
+    static const int RECV_BUF_NUM = 64;
+    static const int RECV_BUF_SIZE = 16 * 1024;
+    static constexpr int MAX_SEND_IOV = 64;
+
+    ///内核不支持需要的特性时返回nullptr
+    static unique_ptr<IoUring> create(unsigned entries = 1024);
+
+    ~IoUring();
+
+    PollerType type() const override { return PollerType::IoUring; }
+
+    ///提交积累的请求并等待完成事件，回调中产生的请求在本次返回前提交，内联完成的事件在本次处理
+    int poll(int timeout_ms = -1) override;
+
+    ///每接受一个连接回调一次，直到cancel
+    void accept_multishot(int listen_fd, const AcceptCallback& cb);
+    ///每收到一批数据回调一次，数据在内核选择的缓冲区中，不需要先等可读再read
+    void recv_multishot(int fd, const RecvCallback& cb);
+    ///iov指向的数据在回调之前必须保持有效，请求在下一次等待之前和其他请求一起提交
+    void send(int fd, const struct iovec *iov, int cnt, const SendCallback& cb);
+    ///取消fd上的accept和recv，立即提交，之后不再回调。send的回调仍然会得到结果，期间数据必须有效
+    void cancel(int fd);
+    ///暂停接收，数据留在内核中由tcp流控限制对端。取消完成前已经收到的数据仍然回调，不会丢失
+    void pause_recv(int fd);
+    void resume_recv(int fd);
+
+    ///io_uring_enter的调用次数
+    uint64_t enter_count() const { return ur_enter_cnt; }
+
+protected:
+    bool commit(io_event *ev) override;
+    void remove(io_event *ev) override;
+
+private:
+    ///fd上的accept和recv请求，gen在取消时加1，过期的完成事件被忽略
+    struct FdOps {
+        uint32_t gen{ 0 };
+        bool active{ false };
+        bool recv_armed{ false };   ///内核中有这个fd的recv请求
+        bool recv_paused{ false };
+        AcceptCallback accept_cb;
+        RecvCallback recv_cb;
+    };
+    ///一个发送请求，完成之前msghdr和iovec保持有效
+    struct SendOp {
+        SendCallback cb;
+        struct msghdr msg;
+        struct iovec iov[MAX_SEND_IOV];
+    };
+
+    IoUring() = default;
+    bool init(unsigned entries);
+    ///确认内核支持用到的操作码和多次触发、按fd取消的标志位
+    bool probe_ops();
+
+    struct io_uring_sqe* get_sqe();
+    ///提交所有请求，wait_nr大于0时最多等待timeout_ms
+    int enter(unsigned wait_nr, int timeout_ms);
+    ///处理已经到达的完成事件，返回处理的个数
+    int reap();
+    bool has_unsubmitted() const { return ur_sq_tail != __atomic_load_n(ur_sq_head_ptr, __ATOMIC_ACQUIRE); }
+    void handle_cqe(uint64_t user_data, int res, uint32_t flags);
+
+    FdOps& fd_ops(int fd);
+    void arm_accept(int fd);
+    void arm_recv(int fd);
+    ///把chunk作为bid号接收缓冲区提供给内核
+    void provide_buf(Chunk *chunk, uint16_t bid);
+
+    int ur_ring_fd{ -1 };
+    unsigned ur_sq_entries{ 0 };
+    unsigned ur_sq_mask{ 0 };
+    unsigned ur_cq_mask{ 0 };
+    unsigned ur_sq_tail{ 0 };
+    unsigned *ur_sq_head_ptr{ nullptr };
+    unsigned *ur_sq_tail_ptr{ nullptr };
+    unsigned *ur_cq_head_ptr{ nullptr };
+    unsigned *ur_cq_tail_ptr{ nullptr };
+    struct io_uring_sqe *ur_sqes{ nullptr };
+    struct io_uring_cqe *ur_cqes{ nullptr };
+    void *ur_ring_ptr{ nullptr };
+    size_t ur_ring_size{ 0 };
+    size_t ur_sqes_size{ 0 };
+
+    ///提供给内核选择的接收缓冲区，以bid为下标，缓冲区是内存池中的chunk，第一次recv时填充
+    Chunk *ur_buf_chunks[RECV_BUF_NUM]{};
+    bool ur_buf_filled{ false };
+
+    ///以fd为下标。回调执行前先移出，执行中被取消或替换时不会析构正在执行的回调
+    vector<FdOps> ur_ops;
+    vector<unique_ptr<SendOp>> ur_send_pool;
+    vector<SendOp*> ur_free_sends;
+
+    uint64_t ur_enter_cnt{ 0 };
+};
+
+#endif
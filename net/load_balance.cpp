@@ -0,0 +1,58 @@
+#include <random>
+
+#include "load_balance.h"
+#include "event_loop.h"
+
+using namespace std;
+
+namespace {
+
+/// 遍历所有loop取key最小的，key相同时从上次选中的下一个开始算起，避免总是选第一个
+template <typename Key>
+LoadBalancer least_by(Key key)
+{
+    return [key, next = size_t(0)](const vector<EventLoop*>& loops) mutable {
+        size_t n = loops.size();
+        size_t best = next % n;
+        auto best_key = key(loops[best]);
+        for (size_t i = 1; i < n; i++) {
+            size_t index = (next + i) % n;
+            auto k = key(loops[index]);
+            if (k < best_key) {
+                best = index;
+                best_key = k;
+            }
+        }
+        next = best + 1;
+        return loops[best];
+    };
+}
+
+}
+
+LoadBalancer make_load_balancer(LoadBalance policy)
+{
+    switch (policy) {
+    case LoadBalance::LeastConns:
+        return least_by([](EventLoop *loop) { return loop->load_conns(); });
+    case LoadBalance::LeastPendingBytes:
+        return least_by([](EventLoop *loop) { return make_pair(loop->pending_bytes(), loop->load_conns()); });
+    case LoadBalance::PowerOfTwoChoices:
+        return [rng = minstd_rand(random_device{}())](const vector<EventLoop*>& loops) mutable {
+            size_t n = loops.size();
+            EventLoop *a = loops[rng() % n];
+            if (n == 1) {
+                return a;
+            }
+            //第二个从其余n-1个中选，保证两个不同
+            size_t i = rng() % (n - 1);
+            EventLoop *b = loops[i] == a ? loops[n - 1] : loops[i];
+            return b->load_conns() < a->load_conns() ? b : a;
+        };
+    case LoadBalance::RoundRobin:
+    default:
+        return [next = size_t(0)](const vector<EventLoop*>& loops) mutable {
+            return loops[next++ % loops.size()];
+        };
+    }
+}
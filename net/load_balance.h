@@ -0,0 +1,25 @@
+#ifndef __LOAD_BALANCE_H__
+#define __LOAD_BALANCE_H__
+
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+class EventLoop;
+
+/// 新连接选择子loop的策略
+enum class LoadBalance {
+    RoundRobin,         /// 轮流选取，不看负载
+    LeastConns,         /// 存活连接数（包括已经分配、还没注册的）最少的loop
+    LeastPendingBytes,  /// 连接缓冲区中积压的字节数最少的loop，相同时选连接数少的
+    PowerOfTwoChoices,  /// 随机选两个loop，取连接数少的，不需要扫描所有loop
+};
+
+/// 自定义策略，从loops中返回一个，只在acceptor线程中调用。
+/// loop的负载计数可以在任意线程中读取，见EventLoop::load_conns和pending_bytes
+typedef function<EventLoop*(const vector<EventLoop*>& loops)> LoadBalancer;
+
+LoadBalancer make_load_balancer(LoadBalance policy);
+
+#endif
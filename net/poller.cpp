@@ -0,0 +1,175 @@
+#include "poller.h"
+#include "../log/log.h"
+
+using namespace std;
+
+//取得fd对应的槽，fd所在的页不存在时分配，已分配的页不会移动
+Poller::io_event* Poller::get_slot(int fd) {
+    if (fd < 0) {
+        return nullptr;
+    }
+    size_t page = static_cast<size_t>(fd) >> PAGE_SHIFT;
+    if (page >= pl_pages.size()) {
+        pl_pages.resize(page + 1);
+    }
+    if (!pl_pages[page]) {
+        pl_pages[page] = make_unique<io_event[]>(PAGE_SIZE);
+    }
+    return &pl_pages[page][fd & (PAGE_SIZE - 1)];
+}
+//替换回调，分发过程中旧的回调可能正在执行，推迟到分发结束后析构
+void Poller::set_callback(EventCallback& slot_cb, const EventCallback& cb) {
+    if (pl_dispatching && slot_cb) {
+        pl_dead_cbs.emplace_back(move(slot_cb));
+    }
+    slot_cb = cb;
+}
+//记录有变化的槽，等到下一次等待之前提交
+void Poller::mark_changed(io_event *ev) {
+    if (!ev->changed) {
+        ev->changed = true;
+        pl_changes.push_back(ev);
+    }
+}
+//添加事件，如果是第一次添加事件，就是添加事件，并设置边缘触发模式，否则修改事件。
+//只修改槽中的事件，提交推迟到apply_changes中执行
+void Poller::add(int fd, int event, const EventCallback& cb) {
+    io_event *ev = get_slot(fd);
+    if (ev == nullptr) {
+        PR_ERROR("poller add invalid fd %d\n", fd);
+        return;
+    }
+    int final_events;
+    ///槽中没有事件，说明是第一次添加事件
+    if (ev->event == 0) {
+        final_events = event|EPOLLET ;///边缘触发模式    
+        ev->fd = fd;
+        pl_fd_cnt++;
+    }
+    ///槽中已有事件，说明是修改事件
+    else {
+        final_events = ev->event | event;
+        ///例如，如果原来的事件是 EPOLLIN（可读事件），新的事件是 EPOLLOUT（可写事件），
+        ///  那么 final_events 就会同时包含 EPOLLIN 和 EPOLLOUT
+    }
+    ///如果是可读事件，设置read_callback
+    if (event & EPOLLIN) {
+        set_callback(ev->read_callback, cb);
+    }
+    ///如果是可写事件，设置write_callback
+    if (event & EPOLLOUT) {
+        set_callback(ev->write_callback, cb);
+    }
+    ///如果是对端半关闭事件，设置close_callback
+    if (event & EPOLLRDHUP) {
+        set_callback(ev->close_callback, cb);
+    }
+
+    ev->event = final_events;
+    mark_changed(ev);
+    LOG_DEBUG("poller add, fd is %d, event is %d \n", fd, final_events);
+}
+
+//删除fd的一个事件，如果删除后事件为空，就删除fd
+///例如，如果原来的事件是 EPOLLIN （可读事件）和 EPOLLOUT（可写事件），
+/// 要删除 EPOLLIN，
+///  那么 final_events 就只剩下 EPOLLOUT
+void Poller::del(int fd, int event) {
+    io_event *ev = find_slot(fd);
+    if (ev == nullptr || ev->event == 0) {
+        return ;
+    }
+    int target_event = ev->event & (~event); ///删除指定event
+    if (target_event == EPOLLET) {
+        this->del(fd);
+    }
+    else {
+        ev->event = target_event;
+        mark_changed(ev);
+    }
+}
+//删除fd，已经加入内核的立即删除，还没有提交的只清空槽
+void Poller::del(int fd) {
+    io_event *ev = find_slot(fd);
+    if (ev == nullptr || ev->event == 0) {
+        return;
+    }
+    if (ev->kernel_event != 0) {
+        this->remove(ev);
+    }
+    clear_slot(ev);
+    pl_fd_cnt--;
+}
+//提交积累的修改，一轮循环中先注册又注销的事件不需要系统调用
+void Poller::apply_changes() {
+    for (size_t i = 0; i < pl_changes.size(); i++) {
+        io_event *ev = pl_changes[i];
+        if (!ev->changed) {
+            //已经被删除
+            continue;
+        }
+        ev->changed = false;
+        if (ev->event == ev->kernel_event) {
+            continue;
+        }
+        if (!this->commit(ev)) {
+            PR_ERROR("poller commit error for fd %d\n", ev->fd);
+            if (ev->kernel_event == 0) {
+                clear_slot(ev);
+                pl_fd_cnt--;
+            }
+            continue;
+        }
+        ev->kernel_event = ev->event;
+    }
+    pl_changes.clear();
+}
+//清空槽，本轮分发中该槽后面的就绪事件会被跳过
+void Poller::clear_slot(io_event *ev) {
+    ev->fd = -1;
+    ev->event = 0;
+    ev->kernel_event = 0;
+    ev->changed = false;
+    set_callback(ev->read_callback, nullptr);
+    set_callback(ev->write_callback, nullptr);
+    set_callback(ev->close_callback, nullptr);
+}
+//分发一个就绪事件，每个回调之后都检查fd是否已经被删除
+void Poller::dispatch(io_event *ev, uint32_t revents) {
+    if (ev->event == 0) {
+        //前面的回调中已经删除了这个fd
+        return;
+    }
+    //内核中的事件还没有更新时，已经注销的事件不再回调
+    revents &= ev->event | EPOLLHUP | EPOLLERR;
+    bool error = revents & (EPOLLHUP|EPOLLERR);
+    //对端关闭了写方向，由关闭回调决定是否还需要读，不再为了得到0而多调用一次read
+    if ((revents & EPOLLRDHUP) && ev->close_callback) {
+        LOG_DEBUG("execute close cb\n");
+        ev->close_callback();
+        if (ev->event == 0) {
+            return;
+        }
+        revents &= ~EPOLLIN;
+    }
+    //出错时读回调能从read的返回值得到错误
+    if ((revents & EPOLLIN) || (error && ev->read_callback)) {
+        LOG_DEBUG("execute read cb\n");
+        if (ev->read_callback) ev->read_callback();
+        if (ev->event == 0) {
+            return;
+        }
+    }
+    //同一次唤醒中可读和可写同时就绪时，写回调也要执行，否则ET模式下要再等一个可写边沿
+    if ((revents & EPOLLOUT) || (error && !ev->read_callback && ev->write_callback)) {
+        LOG_DEBUG("execute write cb\n");
+        if (ev->write_callback) ev->write_callback();
+        if (ev->event == 0) {
+            return;
+        }
+    }
+    if (error && !ev->read_callback && !ev->write_callback) {
+        LOG_INFO("get error, delete fd %d from poller\n", ev->fd);
+        this->del(ev->fd);
+    }
+}
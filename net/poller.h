@@ -0,0 +1,104 @@
+#ifndef __POLLER_H__
+#define __POLLER_H__
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+///EventLoop使用的io多路复用后端
+enum class PollerType {
+    Epoll,
+    IoUring,    ///内核不支持时退回epoll
+};
+
+///io多路复用的公共部分：以fd为下标的事件表、积累到下一次等待之前提交的事件修改、就绪事件的分发。
+///事件使用epoll的EPOLLIN/EPOLLOUT/EPOLLRDHUP，边缘触发，后端只负责把修改提交到内核和等待就绪事件
+class Poller {
+public:
+    typedef function<void()> EventCallback;
+
+    struct io_event 
+    {
+        int fd{ -1 };
+        int event{ 0 };//为0表示没有注册
+        int kernel_event{ 0 };//已经提交到内核中的事件，为0表示还没有加入内核
+        bool changed{ false };//在待提交的修改列表中
+        uint32_t gen{ 0 };//从内核删除时加1（io_uring每次提交也加1），后端用来识别同一个槽过期的就绪事件
+        EventCallback read_callback;
+        EventCallback write_callback;
+        EventCallback close_callback;//对端关闭写方向（EPOLLRDHUP）时调用
+    };
+
+    virtual ~Poller() {}
+
+    virtual PollerType type() const = 0;
+
+    ///注册或增加事件，只修改槽中的事件，在下一次poll之前提交
+    void add(int fd, int event, const EventCallback& cb);
+
+    void del(int fd, int event);
+
+    ///删除fd，fd随后可能被关闭，已经加入内核的立即删除
+    void del(int fd);
+
+    ///提交积累的事件修改，等待并分发就绪事件，timeout_ms小于0时使用默认的等待时间
+    virtual int poll(int timeout_ms = -1) = 0;
+
+    ///把积累的事件修改提交到内核，每个fd最多一次，与内核中相同的不提交
+    void apply_changes();
+
+    ///已注册的fd个数
+    int size() const { return pl_fd_cnt; }
+
+protected:
+    ///把槽中的事件提交到内核，kernel_event为0时是新增，失败返回false
+    virtual bool commit(io_event *ev) = 0;
+    ///立即从内核中删除fd
+    virtual void remove(io_event *ev) = 0;
+
+    ///fd对应的槽，不存在时返回nullptr
+    io_event* find_slot(int fd) const {
+        size_t page = static_cast<size_t>(fd) >> PAGE_SHIFT;
+        if (fd < 0 || page >= pl_pages.size() || !pl_pages[page]) {
+            return nullptr;
+        }
+        return &pl_pages[page][fd & (PAGE_SIZE - 1)];
+    }
+
+    ///分发前后调用，分发过程中被删除或替换的回调推迟到分发结束后析构
+    void begin_dispatch() { pl_dispatching = true; }
+    void end_dispatch() {
+        pl_dispatching = false;
+        pl_dead_cbs.clear();
+    }
+    ///一次处理完一个就绪事件中的所有类型：先半关闭，再读，再写，最后是没有回调处理的错误
+    void dispatch(io_event *ev, uint32_t revents);
+    ///记录有变化的槽，下一次apply_changes时提交
+    void mark_changed(io_event *ev);
+
+private:
+    ///fd对应的槽，不存在时分配所在的页
+    io_event* get_slot(int fd);
+    void clear_slot(io_event *ev);
+    void set_callback(EventCallback& slot_cb, const EventCallback& cb);
+
+    static const int PAGE_SHIFT = 10;
+    static const int PAGE_SIZE = 1 << PAGE_SHIFT;
+
+    int pl_fd_cnt{ 0 };
+
+    ///以fd为下标的事件表，按页分配，页的地址不会改变，
+    ///后端用fd和gen标识内核中的注册，就绪事件直接取到对应的槽，不需要查找
+    vector<unique_ptr<io_event[]>> pl_pages;
+    ///一轮循环中事件有变化的槽，在下一次等待之前统一提交，同一个fd的多次增删合并为一次
+    vector<io_event*> pl_changes;
+
+    bool pl_dispatching{ false };
+    vector<EventCallback> pl_dead_cbs;
+};
+
+#endif
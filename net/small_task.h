@@ -0,0 +1,102 @@
+#ifndef __SMALL_TASK_H__
+#define __SMALL_TASK_H__
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+/// 只能移动的无参可调用对象。
+/// 不超过SMALL_SIZE字节的可调用对象（比如只捕获一个shared_ptr的lambda）直接构造在内部缓冲区中，
+/// 不分配内存；std::function只对可平凡复制的小对象这样做，捕获shared_ptr时也会分配内存。
+class SmallTask {
+public:
+    static const size_t SMALL_SIZE = 48;
+
+    SmallTask() = default;
+
+    template <typename F, typename = enable_if_t<!is_same_v<decay_t<F>, SmallTask>>>
+    SmallTask(F&& f) {
+        typedef decay_t<F> Fn;
+        if constexpr (is_small<Fn>()) {
+            new (st_buf) Fn(forward<F>(f));
+            st_ops = &small_ops<Fn>;
+        }
+        else {
+            *reinterpret_cast<Fn**>(st_buf) = new Fn(forward<F>(f));
+            st_ops = &big_ops<Fn>;
+        }
+    }
+
+    SmallTask(SmallTask&& other) noexcept { move_from(other); }
+
+    SmallTask& operator=(SmallTask&& other) noexcept {
+        if (this != &other) {
+            reset();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    SmallTask(const SmallTask&) = delete;
+    SmallTask& operator=(const SmallTask&) = delete;
+
+    ~SmallTask() { reset(); }
+
+    explicit operator bool() const { return st_ops != nullptr; }
+
+    void operator()() { st_ops->call(st_buf); }
+
+    void reset() {
+        if (st_ops) {
+            st_ops->destroy(st_buf);
+            st_ops = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*call)(void *buf);
+        void (*move)(void *dst, void *src);   /// 移动到dst并析构src
+        void (*destroy)(void *buf);
+    };
+
+    template <typename Fn>
+    static constexpr bool is_small() {
+        return sizeof(Fn) <= SMALL_SIZE && alignof(Fn) <= alignof(max_align_t)
+                && is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template <typename Fn>
+    static constexpr Ops small_ops = {
+        [](void *buf) { (*static_cast<Fn*>(buf))(); },
+        [](void *dst, void *src) {
+            new (dst) Fn(move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void *buf) { static_cast<Fn*>(buf)->~Fn(); },
+    };
+
+    /// 大对象在堆上，缓冲区中只保存指针
+    template <typename Fn>
+    static constexpr Ops big_ops = {
+        [](void *buf) { (**static_cast<Fn**>(buf))(); },
+        [](void *dst, void *src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); },
+        [](void *buf) { delete *static_cast<Fn**>(buf); },
+    };
+
+    void move_from(SmallTask& other) {
+        if (other.st_ops) {
+            other.st_ops->move(st_buf, other.st_buf);
+            st_ops = other.st_ops;
+            other.st_ops = nullptr;
+        }
+    }
+
+    alignas(max_align_t) unsigned char st_buf[SMALL_SIZE];
+    const Ops *st_ops{ nullptr };
+};
+
+#endif
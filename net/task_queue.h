@@ -0,0 +1,110 @@
+#ifndef __TASK_QUEUE_H__
+#define __TASK_QUEUE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <deque>
+
+#include "small_task.h"
+
+using namespace std;
+
+/// 多生产者单消费者的任务队列，EventLoop用它接收其他线程投递的任务。
+/// 主体是有界的无锁环形队列，每个槽带一个序号：生产者用CAS抢占尾部位置，写入任务后发布序号，
+/// 消费者只看自己头部槽的序号，不需要CAS。任务直接构造在槽中，入队出队都不分配内存。
+/// 环形队列满时退化到加锁的溢出队列，一旦溢出队列非空，之后的任务也进入溢出队列，保证同一个生产者的任务有序。
+class TaskQueue {
+public:
+    explicit TaskQueue(size_t capacity = 1024)
+        : tq_cells(new Cell[capacity]), tq_mask(capacity - 1)
+    {
+        assert(capacity > 1 && (capacity & (capacity - 1)) == 0);
+        for (size_t i = 0; i < capacity; i++) {
+            tq_cells[i].seq.store(i, memory_order_relaxed);
+        }
+    }
+
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    /// 任意线程调用
+    void push(SmallTask&& task) {
+        if (tq_overflow_cnt.load(memory_order_acquire) == 0 && try_push(task)) {
+            return;
+        }
+        lock_guard<mutex> lock(tq_mutex);
+        tq_overflow.emplace_back(move(task));
+        tq_overflow_cnt.fetch_add(1, memory_order_release);
+    }
+
+    /// 只能在消费者线程中调用，没有任务时返回false
+    bool pop(SmallTask& task) {
+        Cell& cell = tq_cells[tq_head & tq_mask];
+        if (cell.seq.load(memory_order_acquire) == tq_head + 1) {
+            task = move(cell.task);
+            //槽留给下一圈的生产者
+            cell.seq.store(tq_head + tq_mask + 1, memory_order_release);
+            tq_head++;
+            return true;
+        }
+        if (tq_overflow_cnt.load(memory_order_acquire) > 0) {
+            lock_guard<mutex> lock(tq_mutex);
+            task = move(tq_overflow.front());
+            tq_overflow.pop_front();
+            tq_overflow_cnt.fetch_sub(1, memory_order_release);
+            return true;
+        }
+        return false;
+    }
+
+    /// 只能在消费者线程中调用。生产者已经抢到位置但还没写完的任务也算作非空
+    bool empty() const {
+        return tq_tail.load(memory_order_acquire) == tq_head && tq_overflow_cnt.load(memory_order_acquire) == 0;
+    }
+
+private:
+    struct Cell {
+        atomic<size_t> seq;
+        SmallTask task;
+    };
+
+    bool try_push(SmallTask& task) {
+        size_t pos = tq_tail.load(memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &tq_cells[pos & tq_mask];
+            size_t seq = cell->seq.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tq_tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                //环形队列已满
+                return false;
+            }
+            else {
+                pos = tq_tail.load(memory_order_relaxed);
+            }
+        }
+        cell->task = move(task);
+        cell->seq.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    unique_ptr<Cell[]> tq_cells;
+    size_t tq_mask;
+    alignas(64) atomic<size_t> tq_tail{ 0 };    /// 生产者竞争
+    alignas(64) size_t tq_head{ 0 };            /// 只有消费者访问
+
+    mutex tq_mutex;
+    deque<SmallTask> tq_overflow;
+    atomic<size_t> tq_overflow_cnt{ 0 };
+};
+
+#endif
@@ -1,13 +1,18 @@
 #include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
 #include "tcp_conn.h"
 #include "tcp_server.h"
 #include "event_loop.h"
+#include "io_uring_poller.h"
 #include "../log/pr.h"
 #include "../log/log.h"
 
@@ -18,15 +23,32 @@ TcpConnection::TcpConnection(TcpServer *server, EventLoop* loop, int sockfd, str
     tc_peer_addr = addr;
     tc_peer_addrlen = len;
     tc_loop = loop;
+    tc_uring = loop->get_uring();
     tc_fd = sockfd;
     set_sockfd(tc_fd);//设置为非阻塞
 }
 //添加任务，将连接任务添加到poller中 
 void TcpConnection::add_task() {
-    LOG_INFO("tcp connection add connected task to poller, conn fd is %d\n", tc_fd);
-    tc_loop->add_task([shared_this=shared_from_this()](){ shared_this->connected(); });
-    LOG_INFO("tcp connection add do read to poller, conn fd is %d\n", tc_fd);
-    tc_loop->add_to_poller(tc_fd, EPOLLIN, [shared_this=shared_from_this()](){ shared_this->do_read(); });
+    LOG_INFO("tcp connection add connected task to loop, conn fd is %d\n", tc_fd);
+    tc_loop->add_incoming_conn(1);
+    //连接的所有回调都在所属的loop线程中执行，注册读事件也要在loop线程中进行
+    tc_loop->add_task([shared_this=shared_from_this()](){
+        shared_this->tc_server->add_new_tcp_conn(shared_this);
+        shared_this->tc_loop->add_incoming_conn(-1);
+        shared_this->connected();
+        if (shared_this->tc_fd < 0) {
+            //连接回调中已经关闭
+            return;
+        }
+        if (shared_this->tc_uring) {
+            //数据直接收进内核选择的缓冲区，不需要先等可读事件再read，对端关闭时收到0
+            shared_this->tc_uring->recv_multishot(shared_this->tc_fd, [shared_this](int res, Chunk *chunk){ shared_this->on_recv(res, chunk); });
+            return;
+        }
+        LOG_INFO("tcp connection add do read to poller, conn fd is %d\n", shared_this->tc_fd);
+        shared_this->tc_loop->add_to_poller(shared_this->tc_fd, EPOLLIN, [shared_this](){ shared_this->do_read(); });
+        shared_this->tc_loop->add_to_poller(shared_this->tc_fd, EPOLLRDHUP, [shared_this](){ shared_this->do_peer_shutdown(); });
+    });
 }
 
 TcpConnection::~TcpConnection() {
@@ -39,48 +61,332 @@ void TcpConnection::set_sockfd(int& fd) {
     int op = 1;
     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &op, sizeof(op));
 }
-//读取数据
+//读取数据，ET模式下一直读到内核缓冲区为空，或者达到本次的读预算
 void TcpConnection::do_read() {
-    if (int ret = tc_ibuf.read_from_fd(tc_fd); ret == -1) {
-        PR_ERROR("read data from socket error\n");
-        this->do_close();
+    tc_read_pending = false;
+    int total = 0;
+    bool drained = false;
+    bool peer_closed = false;
+    while (!drained && total < tc_read_budget) {
+        int ret = tc_ibuf.read_from_fd(tc_fd, &drained);
+        if (ret == -1) {
+            if (errno == EAGAIN) {
+                //没有数据可读，比如同一轮分发中已经读完
+                drained = true;
+                break;
+            }
+            if (errno == ECONNRESET) {
+                LOG_INFO("connection reset by peer\n");
+            }
+            else {
+                PR_ERROR("read data from socket error\n");
+            }
+            this->do_close();
+            return;
+        }
+        else if (ret == 0) {
+            LOG_INFO("connection closed by peer\n");
+            peer_closed = true;
+            break;
+        }
+        total += ret;
+    }
+
+    if (total == 0) {
+        if (peer_closed) {
+            this->do_close();
+        }
         return;
     }
-    else if (ret == 0) {
-        LOG_INFO("connection closed by peer\n");
-        this->do_close();
+    this->process_input();
+    if (tc_fd < 0) {
         return;
     }
-    // 执行消息回调 
+    if (peer_closed) {
+        //对端已经关闭，已读到的请求的响应发送完之后关闭
+        this->close_after_write();
+    }
+    else if (!drained && !tc_read_pending) {
+        //读预算用完，内核中可能还有数据，ET模式下不会再通知，让出loop后继续读
+        tc_read_pending = true;
+        tc_loop->queue_task([shared_this=shared_from_this()](){
+            shared_this->tc_read_pending = false;
+            if (shared_this->tc_fd >= 0 && !shared_this->tc_read_paused) {
+                shared_this->do_read();
+            }
+        });
+    }
+}
+
+void TcpConnection::process_input() {
+    // 执行消息回调，回调中可能处理多个流水线请求并多次send，这些数据在回调结束后一次性发送
+    // 等待数据的协程也在这里恢复，写入的数据同样在之后一次性发送
+    tc_in_msg_cb = true;
     tc_message_cb(shared_from_this(), &tc_ibuf);
+    this->resume_reader();
+    tc_in_msg_cb = false;
+
+    flush_output();
+    if (tc_fd >= 0) {
+        this->report_pending_bytes();
+    }
+}
+//io_uring收到数据，数据已经在内核选择的chunk中，直接挂到输入缓冲区
+void TcpConnection::on_recv(int res, Chunk *chunk) {
+    if (tc_fd < 0) {
+        if (chunk != nullptr) {
+            Mempool::get_instance().retrieve(chunk);
+        }
+        return;
+    }
+    if (res > 0) {
+        tc_ibuf.take_chunk(chunk);
+        this->process_input();
+        return;
+    }
+    if (res == 0) {
+        LOG_INFO("connection closed by peer\n");
+        //已读到的请求的响应发送完之后关闭
+        this->close_after_write();
+        return;
+    }
+    if (res == -ECONNRESET) {
+        LOG_INFO("connection reset by peer\n");
+    }
+    else {
+        PR_ERROR("recv data from socket error: %s\n", strerror(-res));
+    }
+    this->do_close();
+}
+//对端关闭了写方向，先读完内核中剩余的数据并处理，然后发送完输出缓冲区再关闭。
+//读到的字节数少于提供的空间就说明已经读完，不需要再read一次得到0
+void TcpConnection::do_peer_shutdown() {
+    LOG_INFO("connection shutdown by peer\n");
+    this->do_read();
+    if (tc_fd >= 0) {
+        this->close_after_write();
+    }
+}
+void TcpConnection::check_water_marks() {
+    if (tc_fd < 0 || tc_high_water_mark <= 0) {
+        return;
+    }
+    int len = tc_obuf.length();
+    if (!tc_above_high_water && len >= tc_high_water_mark) {
+        tc_above_high_water = true;
+        this->pause_reading();
+        if (tc_high_water_cb) {
+            //回调中可能继续send或关闭连接，不在send中直接执行
+            tc_loop->queue_task([shared_this=shared_from_this(), len](){
+                if (shared_this->tc_fd >= 0) {
+                    shared_this->tc_high_water_cb(shared_this, len);
+                }
+            });
+        }
+    }
+    else if (tc_above_high_water && len <= tc_low_water_mark) {
+        tc_above_high_water = false;
+        this->resume_reading();
+        if (tc_low_water_cb) {
+            tc_loop->queue_task([shared_this=shared_from_this()](){
+                if (shared_this->tc_fd >= 0) {
+                    shared_this->tc_low_water_cb(shared_this);
+                }
+            });
+        }
+    }
+}
+
+void TcpConnection::pause_reading() {
+    if (tc_read_paused) {
+        return;
+    }
+    tc_read_paused = true;
+    if (tc_uring) {
+        tc_uring->pause_recv(tc_fd);
+    }
+    else {
+        tc_loop->del_from_poller(tc_fd, EPOLLIN);
+    }
+}
+
+void TcpConnection::resume_reading() {
+    if (!tc_read_paused) {
+        return;
+    }
+    tc_read_paused = false;
+    if (tc_uring) {
+        tc_uring->resume_recv(tc_fd);
+        return;
+    }
+    tc_loop->add_to_poller(tc_fd, EPOLLIN, [shared_this=shared_from_this()](){ shared_this->do_read(); });
+    //暂停期间到达的数据在ET模式下不会再通知，恢复后先读一次
+    if (!tc_read_pending) {
+        tc_read_pending = true;
+        tc_loop->queue_task([shared_this=shared_from_this()](){
+            shared_this->tc_read_pending = false;
+            if (shared_this->tc_fd >= 0 && !shared_this->tc_read_paused) {
+                shared_this->do_read();
+            }
+        });
+    }
+}
 
-    return;
+void TcpConnection::report_pending_bytes() {
+    int64_t bytes = tc_fd < 0 ? 0 : tc_ibuf.length() + tc_obuf.length();
+    if (bytes != tc_reported_bytes) {
+        tc_loop->add_pending_bytes(bytes - tc_reported_bytes);
+        tc_reported_bytes = bytes;
+    }
+}
+//发送消息回调中积累的输出数据
+void TcpConnection::flush_output() {
+    if (tc_fd < 0) {
+        return;
+    }
+    if (!has_pending_output()) {
+        if (tc_close_after_write) {
+            this->do_close();
+        }
+        return;
+    }
+    //已经在等待可写事件，由do_write发送
+    if (!tc_epollout_armed) {
+        this->do_write();
+    }
+}
+//输出缓冲区原来为空、不在消息回调中、也没有在等待可写事件时，send之后直接写，写不完才注册可写事件
+bool TcpConnection::should_write_now() const {
+    return tc_fd >= 0 && !has_pending_output() && !tc_in_msg_cb && !tc_epollout_armed;
 }
 //发送数据
 bool TcpConnection::send(const char *data, int len) {
-    bool should_activate_epollout = false; 
-    //如果输出缓冲区为空，说明之前没有数据，现在有数据了，需要激活epoll_out事件
-    if(tc_obuf.length() == 0) {
-        should_activate_epollout = true;
-    }
+    //消息回调中的send只写缓冲区，由flush_output统一发送
+    bool write_now = should_write_now();
 
     if (int ret = tc_obuf.write2buf(data, len); ret != 0) {
-        PR_ERROR("send data to output buf error\n");
+        //内存池耗尽，已经写入的部分数据不完整，关闭这个连接，不影响其他连接
+        PR_ERROR("send data to output buf error, close conn!\n");
+        this->do_close();
         return false;
     }
 
-    if (should_activate_epollout == true) {
-        //激活epoll_out事件 ,因为输出缓冲区不为空了
-        tc_loop->add_to_poller(tc_fd,EPOLLOUT, [this](){ this->do_write(); });
+    if (write_now && has_pending_output()) {
+        this->do_write();
     }
+    this->check_water_marks();
 
     return true;
 }
-//写数据，将输出缓冲区的数据写入到fd中
+//发送共享缓冲区
+bool TcpConnection::send(const SharedBufSP& buf) {
+    bool write_now = should_write_now();
+
+    tc_obuf.write2buf(buf);
+
+    if (write_now && has_pending_output()) {
+        this->do_write();
+    }
+    this->check_water_marks();
+    return true;
+}
+//发送文件，文件内容不经过用户态
+bool TcpConnection::send_file(const OpenFileSP& file, off_t offset, size_t len) {
+    if (!file || offset < 0 || offset + (off_t)len > file->of_size) {
+        PR_ERROR("send file range error\n");
+        return false;
+    }
+    if (len == 0) {
+        return true;
+    }
+    bool write_now = should_write_now();
+
+    tc_files.push_back(FileSegment{ file, offset, len, tc_obuf_written + tc_obuf.length() });
+
+    if (write_now) {
+        this->do_write();
+    }
+    return true;
+}
+
+bool TcpConnection::send_file(const string& path) {
+    OpenFileSP file = tc_loop->get_file_cache().get(path);
+    if (!file) {
+        return false;
+    }
+    return send_file(file, 0, file->of_size);
+}
+
+int TcpConnection::write_file() {
+    FileSegment& seg = tc_files.front();
+    ssize_t ret;
+    do {
+        ret = sendfile(tc_fd, seg.file->of_fd, &seg.offset, seg.remaining);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1) {
+        return errno == EAGAIN ? 0 : -1;
+    }
+    if (ret == 0) {
+        //文件在发送过程中被截断，已经无法发送声明的长度
+        PR_ERROR("file truncated while sending\n");
+        return -1;
+    }
+    seg.remaining -= ret;
+    if (seg.remaining == 0) {
+        tc_files.pop_front();
+    }
+    return ret;
+}
+//iovec指向输出缓冲区，发送完成之前不消耗数据，完成后在on_send中继续
+void TcpConnection::submit_send(int limit) {
+    struct iovec vec[OutputBuffer::MAX_IOV_NUM];
+    int cnt = tc_obuf.fill_iovec(vec, min<int>(OutputBuffer::MAX_IOV_NUM, IoUring::MAX_SEND_IOV), limit);
+    tc_send_inflight = true;
+    tc_uring->send(tc_fd, vec, cnt, [shared_this=shared_from_this()](int res){ shared_this->on_send(res); });
+}
+
+void TcpConnection::on_send(int res) {
+    tc_send_inflight = false;
+    if (tc_fd < 0) {
+        //发送期间连接已经关闭，现在才能释放输出缓冲区
+        tc_obuf.clear();
+        return;
+    }
+    if (res < 0) {
+        PR_ERROR("send error: %s, close conn!\n", strerror(-res));
+        this->do_close();
+        return;
+    }
+    tc_obuf.consume(res);
+    tc_obuf_written += res;
+    this->do_write();
+}
+//写数据，将输出缓冲区的数据和文件段按顺序写入到fd中
 void TcpConnection::do_write() {
-    while (tc_obuf.length()) {
+    if (tc_send_inflight) {
+        //上一个io_uring发送完成后继续
+        return;
+    }
+    while (has_pending_output()) {
+        //文件段之前的缓冲区数据先发送
+        int limit = tc_files.empty() ? tc_obuf.length() : (int)(tc_files.front().obuf_pos - tc_obuf_written);
         int ret;
-        if (ret = tc_obuf.write2fd(tc_fd); ret == -1) {
+        if (limit > 0 && tc_uring) {
+            //和本轮其他连接的请求一起在下一次等待前提交
+            this->submit_send(limit);
+            return;
+        }
+        if (limit > 0) {
+            ret = tc_obuf.write2fd(tc_fd, limit);
+            if (ret > 0) {
+                tc_obuf_written += ret;
+            }
+        }
+        else {
+            ret = this->write_file();
+        }
+        if (ret == -1) {
             PR_ERROR("write2fd error, close conn!\n");
             this->do_close();
             return ;
@@ -90,29 +396,70 @@ void TcpConnection::do_write() {
         }
     }
 
-    if (tc_obuf.length() == 0) {
-        tc_loop->del_from_poller(tc_fd, EPOLLOUT);
+    this->report_pending_bytes();
+    this->check_water_marks();
+    if (!has_pending_output()) {
+        if (tc_epollout_armed) {
+            //注销在下一次epoll_wait之前提交，同一轮中再次注册时不需要系统调用
+            tc_epollout_armed = false;
+            tc_loop->del_from_poller(tc_fd, EPOLLOUT);
+        }
+        if (tc_close_after_write) {
+            this->do_close();
+            return;
+        }
+        //最后再恢复等待写完的协程，协程中可能继续发送
+        this->resume_writer();
+    }
+    else if (!tc_epollout_armed) {
+        //没有一次写完，等待可写事件
+        tc_epollout_armed = true;
+        tc_loop->add_to_poller(tc_fd, EPOLLOUT, [this](){ this->do_write(); });
     }
 
     return;    
 }
+//发送完输出缓冲区之后关闭连接
+void TcpConnection::close_after_write() {
+    tc_close_after_write = true;
+    if (!has_pending_output() && !tc_in_msg_cb) {
+        this->do_close();
+    }
+}
 //关闭连接
 void TcpConnection::do_close() {
+    if (tc_fd < 0) {
+        return;
+    }
+    //恢复的协程执行完会释放栈帧中的连接引用
+    TcpConnSP guard = shared_from_this();
     if (tc_close_cb) {
         tc_close_cb();
     }
 
     tc_loop->del_from_poller(tc_fd);
+    if (tc_uring) {
+        tc_uring->cancel(tc_fd);
+    }
     tc_ibuf.clear(); 
-    tc_obuf.clear();
+    if (!tc_send_inflight) {
+        //io_uring还在发送时内核会读取输出缓冲区，发送完成后再释放
+        tc_obuf.clear();
+    }
+    tc_files.clear();
 
     int fd = tc_fd;
     tc_fd = -1;
+    this->report_pending_bytes();
     close(fd);
 
     tc_server->do_clean(shared_from_this());
+
+    //等待中的协程得到连接关闭的结果
+    this->resume_reader();
+    this->resume_writer();
 }
-//连接，执行连接回调
+//连接，执行连接回调，启动协程处理函数
 void TcpConnection::connected() {
     if(tc_connected_cb) {
         LOG_INFO("execute connected callback, conn fd is %d\n", tc_fd);
@@ -121,4 +468,57 @@ void TcpConnection::connected() {
     else {
         LOG_INFO("tcp connected callback is null\n");
     }
+    if (tc_co_handler) {
+        tc_co_handler(shared_from_this());
+    }
+}
+
+size_t TcpConnection::find_read_delim(string_view delim) {
+    size_t len = tc_ibuf.length();
+    if (delim.empty() || len < delim.size()) {
+        return 0;
+    }
+    const char *data = tc_ibuf.get_from_buf();
+    if (data == nullptr) {
+        return 0;
+    }
+    size_t start = min(tc_read_scanned, len);
+    const char *pos = static_cast<const char*>(memmem(data + start, len - start, delim.data(), delim.size()));
+    if (pos == nullptr) {
+        //delim可能跨越本次和下次到达的数据
+        tc_read_scanned = len - delim.size() + 1;
+        return 0;
+    }
+    tc_read_scanned = 0;
+    tc_read_found = pos - data + delim.size();
+    return tc_read_found;
+}
+
+void TcpConnection::wait_read(coroutine_handle<> h, string_view delim) {
+    assert(!tc_read_waiter);
+    tc_read_waiter = h;
+    tc_read_delim = delim;
+}
+
+void TcpConnection::wait_write(coroutine_handle<> h) {
+    assert(!tc_write_waiter);
+    tc_write_waiter = h;
+}
+
+void TcpConnection::resume_reader() {
+    if (!tc_read_waiter || (tc_fd >= 0 && find_read_delim(tc_read_delim) == 0)) {
+        return;
+    }
+    coroutine_handle<> h = tc_read_waiter;
+    tc_read_waiter = nullptr;
+    h.resume();
+}
+
+void TcpConnection::resume_writer() {
+    if (!tc_write_waiter) {
+        return;
+    }
+    coroutine_handle<> h = tc_write_waiter;
+    tc_write_waiter = nullptr;
+    h.resume();
 }
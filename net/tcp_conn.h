@@ -6,8 +6,12 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <functional>
+#include <deque>
 
 #include "../memory/data_buf.h"
+#include "../timer/timing_wheel.h"
+#include "file_cache.h"
+#include "coroutine.h"
 
 using namespace std;
 
@@ -17,6 +21,7 @@ typedef shared_ptr<TcpConnection> TcpConnSP;
 
 class EventLoop;
 class TcpServer;
+class IoUring;
 //TcpConnection类，表示一个tcp连接
 class TcpConnection : public enable_shared_from_this<TcpConnection>
 {
@@ -24,6 +29,13 @@ public:
     typedef function<void(const TcpConnSP&)> ConnectionCallback;
     typedef function<void()> CloseCallback;
     typedef function<void(const TcpConnSP&, InputBuffer*)> MessageCallback;
+    ///输出积压超过高水位时回调，参数是当时积压的字节数
+    typedef function<void(const TcpConnSP&, int)> HighWaterCallback;
+    ///协程处理函数，连接建立后在所属loop中启动，参数按值保存在协程栈帧中
+    typedef function<CoTask(TcpConnSP)> CoHandler;
+
+    friend class ReadUntilAwaiter;
+    friend class WriteAwaiter;
 
     TcpConnection(TcpServer *server, EventLoop* loop, int sockfd, struct sockaddr_in& addr, socklen_t& len);
     ~TcpConnection();
@@ -39,40 +51,133 @@ public:
     auto get_fd() { return tc_fd; }
 
     bool send(const char *data, int len);
+    ///发送共享缓冲区，只增加引用计数不拷贝，可以同时发给多个连接
+    bool send(const SharedBufSP& buf);
+    ///发送文件的[offset, offset+len)部分，用sendfile从内核直接发送，不拷贝到输出缓冲区。
+    ///和send的数据按调用的顺序发送
+    bool send_file(const OpenFileSP& file, off_t offset, size_t len);
+    ///通过所属loop的文件缓存打开整个文件并发送，文件不存在时返回false
+    bool send_file(const string& path);
 
     void set_connected_cb(const ConnectionCallback& cb) { tc_connected_cb = cb; }
     void set_message_cb(const MessageCallback& cb) { tc_message_cb = cb; }
     void set_close_cb(const CloseCallback& cb) { tc_close_cb = cb; }
+    void set_read_budget(int bytes) { tc_read_budget = bytes; }
+    void set_co_handler(const CoHandler& handler) { tc_co_handler = handler; }
+
+    ///输出缓冲区积压达到high字节时停止读取对端的输入并回调高水位回调，回落到low字节以下时恢复读取并回调低水位回调，
+    ///应用在两个回调之间暂停产生数据。high为0时不限制。回调投递到所属loop中执行
+    void set_water_marks(int high, int low) { tc_high_water_mark = high; tc_low_water_mark = low; }
+    void set_high_water_cb(const HighWaterCallback& cb) { tc_high_water_cb = cb; }
+    void set_low_water_cb(const ConnectionCallback& cb) { tc_low_water_cb = cb; }
+    ///输出积压超过高水位，还没有回落到低水位
+    bool is_output_congested() const { return tc_above_high_water; }
+
+    ///以下只能在协程处理函数中使用，每个连接同一时间只能有一个协程在等待
+    ReadUntilAwaiter read_until(string_view delim) { return ReadUntilAwaiter(this, delim); }
+    WriteAwaiter write(const char *data, int len) { send(data, len); return WriteAwaiter(this); }
+    WriteAwaiter write(string_view data) { return write(data.data(), static_cast<int>(data.size())); }
+    WriteAwaiter write(const SharedBufSP& buf) { send(buf); return WriteAwaiter(this); }
+    InputBuffer* input() { return &tc_ibuf; }
 
     void connected();  
     void active_close() { do_close(); }
+    ///输出缓冲区中的数据全部发送之后再关闭连接
+    void close_after_write();
+    bool is_closing() const { return tc_close_after_write; }
+    bool is_closed() const { return tc_fd < 0; }
+
+    ///空闲超时定时器节点，挂在所属loop的时间轮上
+    TimingWheel::Node* get_timer_node() { return &tc_timer_node; }
 
-    void set_timer_id(int id) {tc_timer_id = id; }
-    int get_timer_id() { return tc_timer_id; }
+    void set_loop_index(int index) { tc_loop_index = index; }
+    int get_loop_index() const { return tc_loop_index; }
 
 private:
     inline void set_sockfd(int& fd);
     void do_read();
+    void do_peer_shutdown();
+    ///读到新数据后执行消息回调，恢复等待的协程并发送积累的输出
+    void process_input();
+    ///io_uring后端的接收和发送完成回调
+    void on_recv(int res, Chunk *chunk);
+    void on_send(int res);
+    ///把输出缓冲区中最多limit字节交给io_uring发送
+    void submit_send(int limit);
     void do_write();
     void do_close();
+    void flush_output();
+    bool should_write_now() const;
+    ///把缓冲区积压字节数的变化计入所属loop的负载
+    void report_pending_bytes();
+    ///输出缓冲区长度变化后检查是否越过高低水位
+    void check_water_marks();
+    ///停止和恢复读取对端的输入，数据留在内核中，由tcp流控让对端停止发送
+    void pause_reading();
+    void resume_reading();
+    ///发送队列头部的文件段，返回发送的字节数，内核缓冲区满返回0，出错返回-1
+    int write_file();
+    bool has_pending_output() const { return tc_obuf.length() > 0 || !tc_files.empty(); }
+
+    ///在输入缓冲区中查找delim，找到时返回包括delim在内的长度并记录在tc_read_found中，没找到返回0。
+    ///记录已经扫描过的位置，新数据到达后只扫描新的部分
+    size_t find_read_delim(string_view delim);
+    void wait_read(coroutine_handle<> h, string_view delim);
+    void wait_write(coroutine_handle<> h);
+    ///数据到达、输出写完或连接关闭时恢复等待的协程
+    void resume_reader();
+    void resume_writer();
+
+    ///等待发送的文件段，obuf_pos是它在输出流中的位置，之前的缓冲区数据要先发送
+    struct FileSegment {
+        OpenFileSP file;
+        off_t offset;
+        size_t remaining;
+        uint64_t obuf_pos;
+    };
 
     TcpServer* tc_server;//所属的TcpServer
     EventLoop* tc_loop;//所属的EventLoop
+    IoUring* tc_uring{ nullptr };//所属loop是io_uring后端时，收发由io_uring完成
     int tc_fd;//连接的fd
-    int tc_timer_id{ -1 };//定时器id
+    TimingWheel::Node tc_timer_node;//空闲超时定时器，刷新超时时间不需要分配内存
+    int tc_loop_index{ -1 };//在所属EventLoop连接注册表中的下标
+    int tc_read_budget{ 256 * 1024 };//一次读事件中最多读取的字节数
+    bool tc_read_pending{ false };//超过读预算，已经投递了继续读的任务
+    bool tc_read_paused{ false };//输出积压超过高水位，暂停读取
+    int tc_high_water_mark{ 16 * 1024 * 1024 };
+    int tc_low_water_mark{ 4 * 1024 * 1024 };
+    bool tc_above_high_water{ false };
+    int64_t tc_reported_bytes{ 0 };//已经计入loop负载的积压字节数
 
     struct sockaddr_in tc_peer_addr;//对端地址
     socklen_t tc_peer_addrlen;
 
     OutputBuffer tc_obuf;//输出缓冲区       
     InputBuffer tc_ibuf;//输入缓冲区    
+    deque<FileSegment> tc_files;//等待sendfile的文件段
+    uint64_t tc_obuf_written{ 0 };//输出缓冲区累计发送的字节数
 
 
+    bool tc_in_msg_cb{ false };//正在执行消息回调，期间send只写缓冲区，回调结束后一次性发送
+    bool tc_epollout_armed{ false };//是否已经注册了EPOLLOUT事件
+    bool tc_send_inflight{ false };//io_uring的发送还没有完成，期间输出缓冲区中已提交的数据不能释放
+    bool tc_close_after_write{ false };
+
     any tc_context;
 
+    CoHandler tc_co_handler;
+    coroutine_handle<> tc_read_waiter;//等待read_until的协程
+    coroutine_handle<> tc_write_waiter;//等待输出写完的协程
+    string_view tc_read_delim;
+    size_t tc_read_scanned{ 0 };
+    size_t tc_read_found{ 0 };
+
     ConnectionCallback tc_connected_cb;
     MessageCallback tc_message_cb;
     CloseCallback tc_close_cb;
+    HighWaterCallback tc_high_water_cb;
+    ConnectionCallback tc_low_water_cb;
 };
 
 #endif
\ No newline at end of file
@@ -8,8 +8,10 @@
 #include "acceptor.h"
 #include "tcp_server.h"
 #include "event_loop.h"
+#include "cpu_affinity.h"
+#include "../memory/mem_pool.h"
 
-TcpServer::TcpServer(EventLoop* loop, const char *ip, uint16_t port) {    
+TcpServer::TcpServer(EventLoop* loop, const char *ip, uint16_t port, PollerType poller) {    
 
     if (signal(SIGHUP, SIG_IGN) == SIG_ERR) {       // SIGHUP: when terminal closing
         PR_ERROR("ignore SIGHUP signal error\n");
@@ -19,23 +21,21 @@ TcpServer::TcpServer(EventLoop* loop, const char *ip, uint16_t port) {
     }
 
     ts_acceptor_loop = loop;
+    ts_poller_type = poller;
     this->ip = ip;
     this->port = port;
-    ts_message_cb = [this](const TcpConnSP& conn, InputBuffer* ibuf) {
+    ts_conn_msg_cb = [this](const TcpConnSP& conn, InputBuffer* ibuf) {
                         update_conn_timeout_time(conn);
-                        if(ts_msg_cb)
+                        if(ts_user_msg_cb)
                         {
-                            ts_msg_cb(conn, ibuf);
+                            ts_user_msg_cb(conn, ibuf);
                         }
                     };
-    //创建acceptor
-    ts_acceptor = make_unique<Acceptor>(this, loop, ip, port);
 }
 //启动tcp server
 void TcpServer::start() {
     if (!ts_started)
     {
-        ts_timer.run();//启动定时器
         ts_started = true;
         LOG_INFO("tcp server create thread pool, thread num is %d\n", ts_thread_num);
         //创建线程池 
@@ -45,14 +45,51 @@ void TcpServer::start() {
         }
         for(int i=0; i<ts_thread_num; i++)//创建事件循环
         {
-            ts_conn_loops.emplace_back(new EventLoop());
+            ts_conn_loops.emplace_back(new EventLoop(ts_poller_type));
             EventLoop* ev = ts_conn_loops[i];
+            int cpu = ts_loop_cpus.empty() ? -1 : ts_loop_cpus[i % ts_loop_cpus.size()];
+            if (cpu >= 0) {
+                if (ts_cpu_loops.size() <= (size_t)cpu) {
+                    ts_cpu_loops.resize(cpu + 1, nullptr);
+                }
+                if (ts_cpu_loops[cpu] == nullptr) {
+                    ts_cpu_loops[cpu] = ev;
+                }
+            }
             LOG_INFO("tcp server add loop_task to thread pool\n");
-            ts_thread_pool->post_task([&ev]() { ev->loop(); });//将事件循环添加到线程池中
+            ts_thread_pool->post_task([ev, cpu]() {
+                //先绑定cpu再开始循环，之后本线程新建的chunk都在该cpu所在的节点上
+                if (cpu >= 0 && bind_thread_to_cpu(cpu)) {
+                    Mempool::get_instance().bind_node(cpu_numa_node(cpu));
+                }
+                ev->loop();
+            });//将事件循环添加到线程池中
+        }
+        if (ts_acceptor_cpu >= 0) {
+            int cpu = ts_acceptor_cpu;
+            ts_acceptor_loop->add_task([cpu]() {
+                if (bind_thread_to_cpu(cpu)) {
+                    Mempool::get_instance().bind_node(cpu_numa_node(cpu));
+                }
+            });
+        }
+        //创建acceptor，SO_REUSEPORT模式下每个子loop在自己的线程中监听和接受连接
+        if (ts_reuse_port && !ts_conn_loops.empty()) {
+            for (size_t i = 0; i < ts_conn_loops.size(); i++) {
+                EventLoop *ev = ts_conn_loops[i];
+                int cpu = ts_incoming_cpu && !ts_loop_cpus.empty() ? ts_loop_cpus[i % ts_loop_cpus.size()] : -1;
+                ts_loop_acceptors.emplace_back(make_unique<Acceptor>(this, ev, ip, port, true, cpu));
+                Acceptor *acceptor = ts_loop_acceptors.back().get();
+                LOG_INFO("tcp server add listen task to sub eventloop\n");
+                ev->add_task([acceptor](){ acceptor->listen(); });
+            }
+        }
+        else {
+            ts_acceptor = make_unique<Acceptor>(this, ts_acceptor_loop, ip, port);
         }
     }
     //如果没有监听，就添加监听任务
-    if (!ts_acceptor->is_listenning())
+    if (ts_acceptor && !ts_acceptor->is_listenning())
     {
         LOG_INFO("tcp server add listen task to accpetor eventloop\n");
         ts_acceptor_loop->add_task([this](){ this->ts_acceptor->listen(); });
@@ -62,23 +99,83 @@ void TcpServer::start() {
 EventLoop* TcpServer::get_next_loop() {
     int size;
     if(size = ts_conn_loops.size(); size==0) { return nullptr; }
+    if (ts_balancer) {
+        return ts_balancer(ts_conn_loops);
+    }
 
     ++ts_next_loop;
     ts_next_loop = ts_next_loop % size;
     return ts_conn_loops[ts_next_loop]; 
 }
-//清理tcp连接
+//选取绑定在cpu上的事件循环
+EventLoop* TcpServer::get_loop_by_cpu(int cpu) {
+    if (cpu >= 0 && (size_t)cpu < ts_cpu_loops.size() && ts_cpu_loops[cpu] != nullptr) {
+        return ts_cpu_loops[cpu];
+    }
+    return get_next_loop();
+}
+//新连接注册到所属loop的连接表中，在该loop线程中执行，不需要加锁
+void TcpServer::add_new_tcp_conn(const TcpConnSP& tcp_conn) {
+    tcp_conn->getLoop()->add_conn(tcp_conn);
+    add_conn_timer(tcp_conn);
+}
+
+//定时器挂在连接所属loop的时间轮上，回调直接在loop线程中执行
+void TcpServer::add_conn_timer(const TcpConnSP& tcp_conn) {
+    TcpConnection *conn = tcp_conn.get();
+    //连接关闭时会取消定时器，回调执行时连接一定还在loop的注册表中。
+    //关闭会把连接从注册表中删除，先持有一个引用，保证回调执行完之前连接不被析构
+    conn->get_timer_node()->tn_callback = [conn]{
+                        LOG_INFO("tcp conn timeout!\n");
+                        TcpConnSP guard = conn->shared_from_this();
+                        conn->active_close();
+                    };
+    conn->getLoop()->add_timer(conn->get_timer_node(), ts_tcp_conn_timout_ms);
+}
+
+void TcpServer::update_conn_timeout_time(const TcpConnSP& tcp_conn) {
+    tcp_conn->getLoop()->add_timer(tcp_conn->get_timer_node(), ts_tcp_conn_timout_ms);
+}
+//清理tcp连接，在连接所属的loop线程中执行
 void TcpServer::do_clean(const TcpConnSP& tcp_conn) {
-    lock_guard<mutex> lck(mutex);
-    for(auto i=ts_tcp_connections.begin(), e=ts_tcp_connections.end(); i!=e; ++i) {
-        if(tcp_conn==*i) {
-            LOG_INFO("tcpserver do clean, erase tcp_conn\n");
-            ts_tcp_connections.erase(i);
-            break;
-        }
+    LOG_INFO("tcpserver do clean, erase tcp_conn\n");
+    tcp_conn->getLoop()->cancel_timer(tcp_conn->get_timer_node());
+    tcp_conn->getLoop()->remove_conn(tcp_conn);
+}
+
+bool TcpServer::over_memory_budget() const {
+    return ts_memory_budget_kb > 0 && Mempool::get_instance().used_kb() >= ts_memory_budget_kb;
+}
+
+int TcpServer::conn_count() const {
+    int cnt = 0;
+    for (auto loop : ts_conn_loops) {
+        cnt += loop->conn_count();
     }
+    return cnt;
 }
 
-TcpServer::~TcpServer() {
+uint64_t TcpServer::wakeup_count() const {
+    uint64_t cnt = 0;
+    for (auto loop : ts_conn_loops) {
+        cnt += loop->wakeup_count();
+    }
+    return cnt;
+}
 
+void TcpServer::for_each_conn(const function<void(const TcpConnSP&)>& cb) {
+    for (auto loop : ts_conn_loops) {
+        loop->add_task([loop, cb](){ loop->for_each_conn(cb); });
+    }
+}
+
+TcpServer::~TcpServer() {
+    //先让所有子loop退出，线程池才能join，然后释放loop
+    for (auto loop : ts_conn_loops) {
+        loop->quit();
+    }
+    ts_thread_pool.reset();
+    for (auto loop : ts_conn_loops) {
+        delete loop;
+    }
 }
@@ -7,7 +7,8 @@
 #include <mutex>
 
 #include "tcp_conn.h"
-#include "../timer/timer.h"
+#include "load_balance.h"
+#include "poller.h"
 #include "../log/log.h"
 
 class EventLoop;
@@ -20,64 +21,109 @@ public:
     typedef TcpConnection::ConnectionCallback ConnectionCallback;
     typedef TcpConnection::CloseCallback CloseCallback;
     typedef TcpConnection::MessageCallback MessageCallback;
+    typedef TcpConnection::CoHandler CoHandler;
+    typedef TcpConnection::HighWaterCallback HighWaterCallback;
 
     friend class Acceptor;
     friend class TcpConnection;
 
-    TcpServer(EventLoop* loop, const char *ip, uint16_t port); 
+    ///poller是子loop的后端，io_uring不可用时子loop退回epoll。
+    ///acceptor所在loop由调用者创建，它是io_uring后端时用多次触发的accept接受连接
+    TcpServer(EventLoop* loop, const char *ip, uint16_t port, PollerType poller = PollerType::Epoll); 
 
     ~TcpServer();
 
     void set_thread_num(int t_num) { ts_thread_num = t_num; }
+    ///每个子loop使用自己的SO_REUSEPORT监听socket接受连接，必须在start之前设置
+    void set_reuse_port(bool on) { ts_reuse_port = on; }
+    ///按负载均衡策略为新连接选取子loop，默认round robin
     EventLoop* get_next_loop();
+    ///必须在start之前设置
+    void set_load_balance(LoadBalance policy) { ts_balancer = make_load_balancer(policy); }
+    void set_load_balancer(const LoadBalancer& balancer) { ts_balancer = balancer; }
+    ///绑定在cpu上的子loop，没有时按round robin选取
+    EventLoop* get_loop_by_cpu(int cpu);
+
+    ///第i个子loop的线程绑定到cpus[i % cpus.size()]，chunk从该cpu所在NUMA节点的链表中分配，必须在start之前设置
+    void set_loop_cpus(const vector<int>& cpus) { ts_loop_cpus = cpus; }
+    ///acceptor所在loop的线程绑定到cpu，必须在start之前设置
+    void set_acceptor_cpu(int cpu) { ts_acceptor_cpu = cpu; }
+    ///按SO_INCOMING_CPU把连接交给绑定在收包cpu上的子loop，需要同时设置set_loop_cpus。
+    ///SO_REUSEPORT模式下给每个监听socket设置SO_INCOMING_CPU，由内核优先选择同一cpu上的监听socket
+    void set_incoming_cpu_dispatch(bool on) { ts_incoming_cpu = on; }
 
     void start();
     void do_clean(const TcpConnSP& tcp_conn);
 
+    ///所有子loop中存活连接数之和，可以在任意线程中调用
+    int conn_count() const;
+    ///所有子loop从poll返回的次数之和，可以在任意线程中调用
+    uint64_t wakeup_count() const;
+    ///在每个连接所属的loop线程中对其执行cb，异步执行
+    void for_each_conn(const function<void(const TcpConnSP&)>& cb);
+
     void set_tcp_conn_timeout_ms(int ms) { ts_tcp_conn_timout_ms = ms; }
+    ///每个连接一次读事件中最多读取的字节数，超过后让出loop，剩下的数据在下一轮循环中继续读
+    void set_read_budget(int bytes) { ts_read_budget = bytes; }
     void set_connected_cb(const ConnectionCallback& cb) { ts_connected_cb = cb; }
-    void set_message_cb(const MessageCallback& cb) { ts_msg_cb = cb; }
+    void set_message_cb(const MessageCallback& cb) { ts_user_msg_cb = cb; }
     void set_close_cb(const CloseCallback& cb) { ts_close_cb = cb; }
+    ///每个连接建立后在所属loop中启动一个协程处理，可以代替消息回调
+    void set_co_handler(const CoHandler& handler) { ts_co_handler = handler; }
+    ///每个连接输出缓冲区的高低水位，见TcpConnection::set_water_marks，必须在start之前设置
+    void set_water_marks(int high, int low) { ts_high_water_mark = high; ts_low_water_mark = low; }
+    void set_high_water_cb(const HighWaterCallback& cb) { ts_high_water_cb = cb; }
+    void set_low_water_cb(const ConnectionCallback& cb) { ts_low_water_cb = cb; }
+    ///内存池已经分配出去的内存超过kb时拒绝新连接，已有连接排空输出后再接受，0表示不限制。
+    ///达到内存池上限时申请不到内存的连接被关闭，不会退出进程
+    void set_memory_budget_kb(uint64_t kb) { ts_memory_budget_kb = kb; }
+    ///是否超过内存预算，可以在任意线程中调用
+    bool over_memory_budget() const;
 
 private:
-    //添加新的tcp连接
-    void add_new_tcp_conn(const TcpConnSP& tcp_conn) {
-        //设置超时时间  ，超时时间到了就关闭连接 
-        auto timer_id = ts_timer.run_after(ts_tcp_conn_timout_ms, false, [tcp_conn]{
-                            LOG_INFO("tcp conn timeout!\n");
-                            tcp_conn->active_close();
-                        });
-        tcp_conn->set_timer_id(timer_id);
-        ts_tcp_connections.emplace_back(tcp_conn); 
-    }
-
-    void update_conn_timeout_time(const TcpConnSP& tcp_conn) {
-        ts_timer.cancel(tcp_conn->get_timer_id());
-        add_new_tcp_conn(tcp_conn);
-    }
+    //添加新的tcp连接，在连接所属的loop线程中调用
+    void add_new_tcp_conn(const TcpConnSP& tcp_conn);
+
+    //设置超时时间，超时时间到了就关闭连接
+    void add_conn_timer(const TcpConnSP& tcp_conn);
+
+    //刷新超时时间，在连接所属的loop线程中调用
+    void update_conn_timeout_time(const TcpConnSP& tcp_conn);
 
     const char *ip;
     uint16_t port;
     unique_ptr<Acceptor> ts_acceptor;
+    vector<unique_ptr<Acceptor>> ts_loop_acceptors;//SO_REUSEPORT模式下每个子loop一个acceptor
+    bool ts_reuse_port{ false };
 
     EventLoop *ts_acceptor_loop;
     vector<EventLoop*> ts_conn_loops;
+    PollerType ts_poller_type;//子loop的poller后端
     unique_ptr<Threadpool> ts_thread_pool;
     int ts_thread_num{ 4 };
     int ts_next_loop{ -1 };
+    LoadBalancer ts_balancer;
 
-    Timer ts_timer;
     int ts_tcp_conn_timout_ms { 6000 };
+    int ts_read_budget{ 256 * 1024 };
+    int ts_high_water_mark{ 16 * 1024 * 1024 };
+    int ts_low_water_mark{ 4 * 1024 * 1024 };
+    uint64_t ts_memory_budget_kb{ 0 };
 
-    mutex ts_mutex;
-    vector<TcpConnSP> ts_tcp_connections;
+    bool ts_started{ false };
 
-    bool ts_started;
+    vector<int> ts_loop_cpus;
+    vector<EventLoop*> ts_cpu_loops;//以cpu编号索引绑定在该cpu上的子loop
+    int ts_acceptor_cpu{ -1 };
+    bool ts_incoming_cpu{ false };
 
     ConnectionCallback ts_connected_cb;
-    MessageCallback ts_msg_cb;
-    MessageCallback ts_message_cb;
+    MessageCallback ts_user_msg_cb;//set_message_cb设置的回调
+    MessageCallback ts_conn_msg_cb;//交给每个连接的回调：更新连接的超时时间后调用ts_user_msg_cb
     CloseCallback ts_close_cb;
+    CoHandler ts_co_handler;
+    HighWaterCallback ts_high_water_cb;
+    ConnectionCallback ts_low_water_cb;
 }; 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "tcp_server.h"
+#include "event_loop.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_accept [io线程数] [客户端线程数] [每种模式的测试秒数]
+// 分别测试单acceptor和SO_REUSEPORT多acceptor两种模式下每秒建立的连接数，
+// 以及io线程绑定cpu并按SO_INCOMING_CPU分配连接时的连接数，和在收包cpu上处理的连接比例
+
+const char *g_ip = "127.0.0.1";
+
+atomic<long long> g_server_conns{ 0 };
+atomic<long long> g_client_conns{ 0 };
+atomic<long long> g_local_conns{ 0 };
+atomic<bool> g_running{ false };
+
+void client_func(uint16_t port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_aton(g_ip, &addr.sin_addr);
+
+    //RST关闭，避免客户端端口大量处于TIME_WAIT
+    linger lg = { 1, 0 };
+    while (g_running.load(memory_order_relaxed)) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+        if (connect(fd, (sockaddr*)&addr, sizeof addr) == 0) {
+            g_client_conns.fetch_add(1, memory_order_relaxed);
+        }
+        close(fd);
+    }
+}
+
+double run_bench(bool reuse_port, bool pinned, uint16_t port, int io_threads, int client_threads, int seconds)
+{
+    g_server_conns = 0;
+    g_client_conns = 0;
+    g_local_conns = 0;
+
+    EventLoop base_loop;
+    double conns_per_sec;
+    {
+        TcpServer server(&base_loop, g_ip, port);
+        server.set_thread_num(io_threads);
+        server.set_reuse_port(reuse_port);
+        if (pinned) {
+            int cpu_num = thread::hardware_concurrency();
+            vector<int> cpus;
+            for (int i = 0; i < io_threads; i++) {
+                cpus.push_back(i % cpu_num);
+            }
+            server.set_loop_cpus(cpus);
+            server.set_incoming_cpu_dispatch(true);
+        }
+        server.set_connected_cb([](const TcpConnSP& conn){
+            g_server_conns.fetch_add(1, memory_order_relaxed);
+            int cpu = -1;
+            socklen_t len = sizeof cpu;
+            if (getsockopt(conn->get_fd(), SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu == sched_getcpu()) {
+                g_local_conns.fetch_add(1, memory_order_relaxed);
+            }
+        });
+        server.set_message_cb([](const TcpConnSP&, InputBuffer* ibuf){ ibuf->clear(); });
+        server.start();
+        thread base_thread([&base_loop](){ base_loop.loop(); });
+        this_thread::sleep_for(chrono::milliseconds(200));
+
+        g_running = true;
+        vector<thread> clients;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < client_threads; i++) {
+            clients.emplace_back(client_func, port);
+        }
+        this_thread::sleep_for(chrono::seconds(seconds));
+        g_running = false;
+        for (auto& t : clients) {
+            t.join();
+        }
+        auto end = chrono::steady_clock::now();
+        double sec = chrono::duration<double>(end - start).count();
+        conns_per_sec = g_server_conns.load() / sec;
+
+        const char *mode = reuse_port ? (pinned ? "[reuse-pin]" : "[reuseport]") : (pinned ? "[single-pin]" : "[single]");
+        PR_INFO("%-12s io threads: %d, client threads: %d, client connects: %lld, server accepted: %lld, %.0f conns/s, "
+                "on incoming cpu %.0f%%\n", mode, io_threads, client_threads,
+                g_client_conns.load(), g_server_conns.load(), conns_per_sec,
+                100.0 * g_local_conns.load() / max(1LL, g_server_conns.load()));
+
+        base_loop.quit();
+        base_thread.join();
+    }
+    return conns_per_sec;
+}
+
+int main(int argc, char *argv[])
+{
+    int io_threads = argc > 1 ? atoi(argv[1]) : 4;
+    int client_threads = argc > 2 ? atoi(argv[2]) : 4;
+    int seconds = argc > 3 ? atoi(argv[3]) : 3;
+
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+
+    double single = run_bench(false, false, 8881, io_threads, client_threads, seconds);
+    double reuse = run_bench(true, false, 8882, io_threads, client_threads, seconds);
+    PR_INFO("reuseport / single = %.2f\n", single > 0 ? reuse / single : 0.0);
+    run_bench(false, true, 8879, io_threads, client_threads, seconds);
+    run_bench(true, true, 8878, io_threads, client_threads, seconds);
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tcp_server.h"
+#include "event_loop.h"
+#include "../memory/mem_pool.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_backpressure [每个连接的请求数]
+// 客户端一次发出所有请求（每行一个，每个响应64K）后暂停读取，模拟读得很慢的对端。
+// 第一部分对比不设水位和设置1M/256K水位时内存池占用的峰值：设置水位后服务器在高水位停止处理和读取，
+// 低水位回调中继续处理留在输入缓冲区中的请求，客户端最后仍然收到全部响应。epoll和io_uring后端各测一次。
+// 第二部分设置内存池上限和内存预算：达到上限时申请不到内存的连接被关闭，进程不退出；
+// 超过预算时新连接被拒绝，内存释放后重新接受连接
+
+const char *g_ip = "127.0.0.1";
+uint16_t g_port = 8899;
+
+const int RESP_SIZE = 64 * 1024;
+string g_resp(RESP_SIZE, 'r');
+
+atomic<int> g_high_cnt{ 0 };
+atomic<int> g_low_cnt{ 0 };
+
+int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    inet_aton(g_ip, &addr.sin_addr);
+
+    for (int i = 0; i < 50; i++) {
+        if (connect(fd, (sockaddr*)&addr, sizeof addr) == 0) {
+            return fd;
+        }
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    assert(false);
+    return -1;
+}
+
+void send_requests(int fd, int requests)
+{
+    string reqs;
+    for (int i = 0; i < requests; i++) {
+        reqs.append("G\n");
+    }
+    assert(write(fd, reqs.data(), reqs.size()) == (ssize_t)reqs.size());
+}
+
+/// 读到对端关闭或读完expect字节，返回读到的字节数
+long long read_all(int fd, long long expect)
+{
+    vector<char> buf(256 * 1024);
+    long long got = 0;
+    while (got < expect) {
+        ssize_t n = read(fd, buf.data(), buf.size());
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    return got;
+}
+
+/// 输出积压超过高水位后暂停处理，剩下的请求留在输入缓冲区，低水位回调中继续
+void on_message(const TcpConnSP& conn, InputBuffer *ibuf)
+{
+    while (ibuf->length() >= 2 && !conn->is_output_congested()) {
+        ibuf->pop(2);
+        if (!conn->send(g_resp.data(), RESP_SIZE)) {
+            return;
+        }
+    }
+}
+
+void setup(TcpServer& server)
+{
+    server.set_thread_num(2);
+    server.set_tcp_conn_timeout_ms(60000);
+    server.set_message_cb(on_message);
+    server.set_high_water_cb([](const TcpConnSP&, int){ g_high_cnt++; });
+    server.set_low_water_cb([](const TcpConnSP& conn){
+        g_low_cnt++;
+        on_message(conn, conn->input());
+    });
+}
+
+/// 在后台采样内存池占用的峰值
+class PeakSampler {
+public:
+    PeakSampler() : ps_thread([this](){
+        while (ps_running) {
+            ps_peak = max<uint64_t>(ps_peak, Mempool::get_instance().used_kb());
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }) {}
+    ~PeakSampler() { stop(); }
+    uint64_t stop() {
+        if (ps_running.exchange(false)) {
+            ps_thread.join();
+        }
+        return ps_peak;
+    }
+private:
+    atomic<bool> ps_running{ true };
+    atomic<uint64_t> ps_peak{ 0 };
+    thread ps_thread;
+};
+
+void run_water_marks(const char *name, PollerType type, int high, int low, int requests)
+{
+    EventLoop base_loop(type);
+    TcpServer server(&base_loop, g_ip, g_port, type);
+    setup(server);
+    server.set_water_marks(high, low);
+    server.start();
+    thread base_thread([&base_loop](){ base_loop.loop(); });
+    g_high_cnt = 0;
+    g_low_cnt = 0;
+
+    uint64_t before = Mempool::get_instance().used_kb();
+    PeakSampler sampler;
+    int fd = connect_server();
+    send_requests(fd, requests);
+    //对端暂停读取，服务器积压的输出只受水位限制
+    this_thread::sleep_for(chrono::milliseconds(300));
+    long long expect = (long long)requests * RESP_SIZE;
+    long long got = read_all(fd, expect);
+    uint64_t peak = sampler.stop();
+    close(fd);
+
+    PR_INFO("[%-9s %-5s] high %7d, low %7d, received %lld/%lld bytes, pool peak %6llu KB, high cb %d, low cb %d\n",
+                name, base_loop.poller_type() == PollerType::IoUring ? "uring" : "epoll", high, low,
+                got, expect, (unsigned long long)(peak - min(peak, before)), g_high_cnt.load(), g_low_cnt.load());
+    assert(got == expect);
+
+    base_loop.quit();
+    base_thread.join();
+    g_port++;
+}
+
+/// 连接后发送一个请求，能收到响应说明被接受，对端直接关闭说明被拒绝
+bool probe()
+{
+    int fd = connect_server();
+    send_requests(fd, 1);
+    bool ok = read_all(fd, RESP_SIZE) == RESP_SIZE;
+    close(fd);
+    return ok;
+}
+
+void run_budget(int requests)
+{
+    const uint64_t budget_kb = 32 * 1024;
+    EventLoop base_loop;
+    TcpServer server(&base_loop, g_ip, g_port);
+    setup(server);
+    //不设水位，积压只受内存池上限和内存预算限制
+    server.set_water_marks(0, 0);
+    server.start();
+    thread base_thread([&base_loop](){ base_loop.loop(); });
+
+    //上限不再新建chunk，慢连接用完空闲的chunk后申请失败，只有这个连接被关闭
+    Mempool::get_instance().set_limit_kb(Mempool::get_instance().used_kb());
+    int bomb = connect_server();
+    long long expect = (long long)requests * 2 * RESP_SIZE;
+    send_requests(bomb, requests * 2);
+    long long got = read_all(bomb, expect);
+    close(bomb);
+    bool accepted = probe();
+    PR_INFO("[limit    ] connection closed by server after %lld/%lld bytes, new connection %s\n",
+                got, expect, accepted ? "accepted" : "refused");
+    assert(got < expect && accepted);
+    Mempool::get_instance().set_limit_kb(MAX_POOL_SIZE);
+
+    //慢连接的积压超过预算，新连接被拒绝
+    this_thread::sleep_for(chrono::milliseconds(100));
+    uint64_t base_kb = Mempool::get_instance().used_kb();
+    server.set_memory_budget_kb(base_kb + budget_kb);
+    int hog = connect_server();
+    send_requests(hog, budget_kb * 2 * 1024 / RESP_SIZE);
+    this_thread::sleep_for(chrono::milliseconds(200));
+    int refused = 0;
+    for (int i = 0; i < 3; i++) {
+        refused += !probe();
+    }
+    PR_INFO("[budget   ] pool used %llu KB over budget %llu KB, refused %d/3 new connections\n",
+                (unsigned long long)(Mempool::get_instance().used_kb() - base_kb), (unsigned long long)budget_kb, refused);
+
+    //慢连接关闭后内存回到预算以内，重新接受连接
+    close(hog);
+    this_thread::sleep_for(chrono::milliseconds(200));
+    accepted = probe();
+    PR_INFO("[recover  ] pool used %llu KB, new connection %s\n",
+                (unsigned long long)(Mempool::get_instance().used_kb() - min(base_kb, Mempool::get_instance().used_kb())),
+                accepted ? "accepted" : "refused");
+    assert(refused == 3 && accepted);
+
+    base_loop.quit();
+    base_thread.join();
+    g_port++;
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+    int requests = argc > 1 ? atoi(argv[1]) : 4000;
+
+    run_water_marks("unlimited", PollerType::Epoll, 0, 0, requests);
+    run_water_marks("marks", PollerType::Epoll, 1024 * 1024, 256 * 1024, requests);
+    run_water_marks("unlimited", PollerType::IoUring, 0, 0, requests);
+    run_water_marks("marks", PollerType::IoUring, 1024 * 1024, 256 * 1024, requests);
+    run_budget(requests);
+    return 0;
+}
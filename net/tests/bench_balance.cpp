@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tcp_server.h"
+#include "event_loop.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_balance [io线程数] [每种策略的测试秒数] [重请求耗时us] [spin]
+// 偏斜负载：每建立io线程数个连接中有一个长连接持续发送耗时的重请求，其余是一问一答后关闭的短连接，共io线程数/2个重连接。
+// round robin会把所有重连接分到同一个loop上，之后分到这个loop的短连接要排在多个重请求后面。
+// 对每种负载均衡策略统计重连接占用的loop个数，以及短连接（建立连接+一次请求）的延迟分位数。
+// 默认重请求在loop线程中sleep，模拟同步读磁盘这类阻塞loop但不占cpu的处理；加spin参数改为忙等，
+// 这时只有cpu核数不少于io线程数，把重连接分散开才有意义
+
+const char *g_ip = "127.0.0.1";
+uint16_t g_port = 8897;
+
+typedef chrono::steady_clock Clock;
+
+int g_heavy_us = 1000;
+bool g_heavy_spin = false;
+atomic<bool> g_running{ false };
+
+mutex g_heavy_mutex;
+set<EventLoop*> g_heavy_loops;
+
+int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    inet_aton(g_ip, &addr.sin_addr);
+
+    for (int i = 0; i < 50; i++) {
+        if (connect(fd, (sockaddr*)&addr, sizeof addr) == 0) {
+            return fd;
+        }
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    assert(false);
+    return -1;
+}
+
+/// 一次请求：发送一行，读到"ok\n"
+bool request(int fd, const char *line)
+{
+    if (write(fd, line, strlen(line)) != (ssize_t)strlen(line)) {
+        return false;
+    }
+    char buf[3];
+    size_t got = 0;
+    while (got < sizeof buf) {
+        ssize_t n = read(fd, buf + got, sizeof buf - got);
+        if (n <= 0) {
+            return false;
+        }
+        got += n;
+    }
+    return memcmp(buf, "ok\n", 3) == 0;
+}
+
+/// 每行一个请求，H是重请求，在loop线程中忙等g_heavy_us微秒
+void on_message(const TcpConnSP& conn, InputBuffer *ibuf)
+{
+    while (ibuf->length() >= 2) {
+        const char *data = ibuf->get_from_buf();
+        if (data[0] == 'H') {
+            {
+                lock_guard<mutex> lock(g_heavy_mutex);
+                g_heavy_loops.insert(conn->getLoop());
+            }
+            if (g_heavy_spin) {
+                auto end = Clock::now() + chrono::microseconds(g_heavy_us);
+                while (Clock::now() < end);
+            }
+            else {
+                this_thread::sleep_for(chrono::microseconds(g_heavy_us));
+            }
+        }
+        ibuf->pop(2);
+        conn->send("ok\n", 3);
+    }
+}
+
+void heavy_client(int fd)
+{
+    while (g_running && request(fd, "H\n"));
+    close(fd);
+}
+
+void light_client(vector<double> *latency)
+{
+    while (g_running) {
+        auto t1 = Clock::now();
+        int fd = connect_server();
+        bool ok = request(fd, "L\n");
+        close(fd);
+        if (ok) {
+            latency->push_back(chrono::duration<double, micro>(Clock::now() - t1).count());
+        }
+    }
+}
+
+void run(const char *name, LoadBalance policy, int io_threads, int seconds)
+{
+    EventLoop base_loop;
+    TcpServer server(&base_loop, g_ip, g_port);
+    server.set_thread_num(io_threads);
+    server.set_tcp_conn_timeout_ms(60000);
+    server.set_load_balance(policy);
+    server.set_message_cb(on_message);
+    server.start();
+    thread base_thread([&base_loop](){ base_loop.loop(); });
+    g_heavy_loops.clear();
+    g_running = true;
+
+    //每io_threads个连接中第一个是重连接，其余是短连接
+    vector<thread> heavy;
+    for (int i = 0; i < max(1, io_threads / 2); i++) {
+        int fd = connect_server();
+        heavy.emplace_back(heavy_client, fd);
+        this_thread::sleep_for(chrono::milliseconds(5));
+        for (int j = 1; j < io_threads; j++) {
+            int light = connect_server();
+            request(light, "L\n");
+            close(light);
+        }
+    }
+    this_thread::sleep_for(chrono::milliseconds(100));
+
+    vector<vector<double>> latency(4);
+    vector<thread> light;
+    for (auto& lat : latency) {
+        light.emplace_back(light_client, &lat);
+    }
+    this_thread::sleep_for(chrono::seconds(seconds));
+    g_running = false;
+    for (auto& t : light) {
+        t.join();
+    }
+    for (auto& t : heavy) {
+        t.join();
+    }
+
+    vector<double> all;
+    for (auto& lat : latency) {
+        all.insert(all.end(), lat.begin(), lat.end());
+    }
+    sort(all.begin(), all.end());
+    auto pct = [&all](double p) { return all.empty() ? 0.0 : all[min(all.size() - 1, (size_t)(all.size() * p))]; };
+    size_t heavy_loops;
+    {
+        lock_guard<mutex> lock(g_heavy_mutex);
+        heavy_loops = g_heavy_loops.size();
+    }
+    PR_INFO("[%-10s] heavy conns on %zu/%d loops, short conns %zu, p50 %.0f us, p99 %.0f us, p999 %.0f us\n",
+                name, heavy_loops, io_threads, all.size(), pct(0.5), pct(0.99), pct(0.999));
+
+    base_loop.quit();
+    base_thread.join();
+    g_port++;
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+    int io_threads = argc > 1 ? atoi(argv[1]) : 4;
+    int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    g_heavy_us = argc > 3 ? atoi(argv[3]) : 1000;
+    g_heavy_spin = argc > 4 && strcmp(argv[4], "spin") == 0;
+
+    run("roundrobin", LoadBalance::RoundRobin, io_threads, seconds);
+    run("leastconn", LoadBalance::LeastConns, io_threads, seconds);
+    run("leastbytes", LoadBalance::LeastPendingBytes, io_threads, seconds);
+    run("p2c", LoadBalance::PowerOfTwoChoices, io_threads, seconds);
+    return 0;
+}
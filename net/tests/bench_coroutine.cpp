@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "tcp_server.h"
+#include "event_loop.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_coroutine [连接数] [每个连接的往返次数]
+// 同一个按行回显的协议分别用消息回调和协程处理函数实现，多个客户端一问一答，
+// 对比每秒往返次数。客户端分两批连接，第二批连接的协程栈帧从loop的帧池中复用。
+// 另外检查co_await loop->sleep的延迟，以及连接关闭后等待中的协程都能结束
+
+const char *g_ip = "127.0.0.1";
+uint16_t g_port = 8896;
+
+atomic<int> g_finished{ 0 };
+
+int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    inet_aton(g_ip, &addr.sin_addr);
+
+    for (int i = 0; i < 50; i++) {
+        if (connect(fd, (sockaddr*)&addr, sizeof addr) == 0) {
+            return fd;
+        }
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    assert(false);
+    return -1;
+}
+
+void write_all(int fd, const string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+        assert(n > 0);
+        sent += n;
+    }
+}
+
+string read_n(int fd, size_t len)
+{
+    string got(len, '\0');
+    size_t n = 0;
+    while (n < len) {
+        ssize_t ret = read(fd, &got[n], len - n);
+        assert(ret > 0);
+        n += ret;
+    }
+    return got;
+}
+
+/// 消息回调版本：自己在缓冲区中找行尾，一次回调可能处理多行
+void echo_message_cb(const TcpConnSP& conn, InputBuffer *ibuf)
+{
+    while (ibuf->length() > 0) {
+        const char *data = ibuf->get_from_buf();
+        const char *end = static_cast<const char*>(memmem(data, ibuf->length(), "\r\n", 2));
+        if (end == nullptr) {
+            break;
+        }
+        int n = end - data + 2;
+        conn->send(data, n);
+        ibuf->pop(n);
+    }
+}
+
+/// 协程版本：按顺序写协议逻辑，不需要在context中保存状态
+CoTask echo_handler(TcpConnSP conn)
+{
+    while (true) {
+        size_t n = co_await conn->read_until("\r\n");
+        if (n == 0) {
+            break;
+        }
+        const char *data = conn->input()->get_from_buf();
+        if (string_view(data, n) == "sleep\r\n") {
+            conn->input()->pop(n);
+            co_await conn->getLoop()->sleep(50);
+            co_await conn->write("slept\r\n");
+            continue;
+        }
+        co_await conn->write(data, n);
+        conn->input()->pop(n);
+    }
+    g_finished++;
+}
+
+void client(int rounds)
+{
+    int fd = connect_server();
+    for (int i = 0; i < rounds; i++) {
+        string line = "line " + to_string(i) + "\r\n";
+        write_all(fd, line);
+        assert(read_n(fd, line.size()) == line);
+    }
+    close(fd);
+}
+
+/// 帧池计数是线程局部的，到loop线程中读取
+void frame_counts(EventLoop *loop, size_t *reuse, size_t *alloc)
+{
+    atomic<bool> done{ false };
+    loop->add_task([&](){
+        *reuse = FramePool::reuse_count();
+        *alloc = FramePool::alloc_count();
+        done = true;
+    });
+    while (!done) {
+        this_thread::yield();
+    }
+}
+
+void run(bool coroutine, int conns, int rounds)
+{
+    EventLoop base_loop;
+    TcpServer server(&base_loop, g_ip, g_port);
+    server.set_tcp_conn_timeout_ms(60000);
+    if (coroutine) {
+        server.set_co_handler(echo_handler);
+    }
+    else {
+        server.set_message_cb(echo_message_cb);
+    }
+    server.set_thread_num(1);
+    server.start();
+    thread base_thread([&base_loop](){ base_loop.loop(); });
+
+    g_finished = 0;
+    auto t1 = chrono::steady_clock::now();
+    for (int wave = 0; wave < 2; wave++) {
+        vector<thread> clients;
+        for (int i = 0; i < conns; i++) {
+            clients.emplace_back(client, rounds / 2);
+        }
+        for (auto& t : clients) {
+            t.join();
+        }
+    }
+    auto t2 = chrono::steady_clock::now();
+
+    double sec = chrono::duration<double>(t2 - t1).count();
+    PR_INFO("[%-9s] connections %d, %.0f round trips/s\n", coroutine ? "coroutine" : "callback",
+                conns, (double)conns * (rounds / 2 * 2) / sec);
+
+    if (coroutine) {
+        int fd = connect_server();
+        auto s1 = chrono::steady_clock::now();
+        write_all(fd, "sleep\r\n");
+        assert(read_n(fd, 7) == "slept\r\n");
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - s1).count();
+        assert(ms >= 50);
+        close(fd);
+
+        for (int i = 0; i < 100 && g_finished != 2 * conns + 1; i++) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        assert(g_finished == 2 * conns + 1);
+        size_t reuse = 0, alloc = 0;
+        frame_counts(server.get_next_loop(), &reuse, &alloc);
+        PR_INFO("[%-9s] sleep 50 ms took %lld ms, all handlers finished, frames reused %zu, allocated %zu\n",
+                    "coroutine", (long long)ms, reuse, alloc);
+    }
+
+    base_loop.quit();
+    base_thread.join();
+    g_port++;
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+    int conns = argc > 1 ? atoi(argv[1]) : 16;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5000;
+
+    run(false, conns, rounds);
+    run(true, conns, rounds);
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "epoll.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_epoll_dispatch [轮数] [fd个数...]
+// 每轮让所有fd同时就绪，统计Epoll::poll平均每个就绪事件的耗时（包含epoll_wait），
+// 另外单独对比按fd查unordered_map和Epoll按data中的fd取分页事件表的槽并检查gen两种分发方式的查找开销
+
+typedef chrono::steady_clock Clock;
+
+/// 尽量把打开文件数上限调到能容纳n个fd，返回实际可用的fd个数
+int raise_fd_limit(int n)
+{
+    rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rlim_t want = n + 64;
+    if (rl.rlim_cur < want) {
+        rl.rlim_cur = min(want, rl.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    return min<long long>(n, (long long)rl.rlim_cur - 64);
+}
+
+double bench_poll(int fd_num, int rounds)
+{
+    Epoll epoller;
+    vector<int> fds;
+    long long fired = 0;
+    for (int i = 0; i < fd_num; i++) {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            break;
+        }
+        fds.push_back(fd);
+        epoller.add(fd, EPOLLIN, [&fired](){ fired++; });
+    }
+    //注册在poll之前才提交到内核，不计入分发耗时
+    epoller.apply_changes();
+
+    uint64_t one = 1;
+    long long expect = 0;
+    Clock::duration cost{ 0 };
+    for (int r = 0; r < rounds; r++) {
+        //每次写eventfd都会产生一个新的边沿，回调里不读也会再次就绪
+        for (int fd : fds) {
+            if (write(fd, &one, sizeof one) != sizeof one) {
+                PR_ERROR("write eventfd %d error\n", fd);
+            }
+        }
+        expect += fds.size();
+        auto t1 = Clock::now();
+        while (fired < expect) {
+            epoller.poll(0);
+        }
+        cost += Clock::now() - t1;
+    }
+
+    for (int fd : fds) {
+        epoller.del(fd);
+        close(fd);
+    }
+    return chrono::duration<double, nano>(cost).count() / expect;
+}
+
+/// 可以直接调用分发时取槽的函数
+class LookupEpoll : public Epoll {
+public:
+    using Epoll::ready_slot;
+};
+
+/// 只比较查找：旧实现每个就绪事件按fd查一次unordered_map，新实现用Epoll分发时的ready_slot取槽并比较gen。
+/// fd通过Epoll注册，就绪事件是epoll_wait返回的，data就是后端提交到内核的内容
+void bench_lookup(int fd_num, int rounds)
+{
+    LookupEpoll epoller;
+    unordered_map<int, Epoll::io_event> event_map;
+    vector<int> fds;
+    long long fired = 0;
+    for (int i = 0; i < fd_num; i++) {
+        int fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            break;
+        }
+        fds.push_back(fd);
+        epoller.add(fd, EPOLLIN, [&fired](){ fired++; });
+        event_map[fd].read_callback = [&fired](){ fired++; };
+    }
+    epoller.apply_changes();
+
+    vector<epoll_event> ready(fds.size());
+    size_t got = 0;
+    while (got < ready.size()) {
+        int n = epoll_wait(epoller.get_epoll_fd(), ready.data() + got, ready.size() - got, 0);
+        if (n <= 0) {
+            PR_ERROR("epoll wait got %zu of %zu events\n", got, ready.size());
+            break;
+        }
+        got += n;
+    }
+    ready.resize(got);
+    //就绪顺序与fd顺序无关
+    shuffle(ready.begin(), ready.end(), mt19937(1));
+
+    auto t1 = Clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (auto& e : ready) {
+            event_map.find(static_cast<int>(static_cast<uint32_t>(e.data.u64)))->second.read_callback();
+        }
+    }
+    auto t2 = Clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (auto& e : ready) {
+            if (Epoll::io_event *ev = epoller.ready_slot(e); ev != nullptr) {
+                ev->read_callback();
+            }
+        }
+    }
+    auto t3 = Clock::now();
+
+    for (int fd : fds) {
+        epoller.del(fd);
+        close(fd);
+    }
+
+    double total = (double)ready.size() * rounds;
+    PR_INFO("lookup+call, fds %zu: unordered_map %.1f ns/event, slot %.1f ns/event\n", ready.size(),
+                chrono::duration<double, nano>(t2 - t1).count() / total,
+                chrono::duration<double, nano>(t3 - t2).count() / total);
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    vector<int> sizes;
+    for (int i = 2; i < argc; i++) {
+        sizes.push_back(atoi(argv[i]));
+    }
+    if (sizes.empty()) {
+        sizes = { 10000, 100000 };
+    }
+
+    for (int n : sizes) {
+        int fd_num = raise_fd_limit(n);
+        if (fd_num < n) {
+            PR_WARN("fd limit too small, use %d fds instead of %d\n", fd_num, n);
+        }
+        PR_INFO("poll+dispatch, fds %d: %.1f ns/event\n", fd_num, bench_poll(fd_num, rounds));
+        bench_lookup(fd_num, rounds);
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tcp_server.h"
+#include "event_loop.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_poller [io线程数] [每个场景的测试秒数]
+// 同样的服务器分别用epoll和io_uring后端运行，对比三种负载：
+// 单个长连接一问一答的小请求（看单次往返的延迟），16个长连接并发的小请求（看批量提交的吞吐），
+// 4个长连接请求256K的大响应（看接收缓冲区和发送路径的吞吐）。
+// 每个请求是一行，S返回64字节，B返回256K，统计每秒请求数、带宽和延迟分位数，以及所有子loop的唤醒次数
+
+const char *g_ip = "127.0.0.1";
+uint16_t g_port = 8898;
+
+typedef chrono::steady_clock Clock;
+
+const int SMALL_RESP = 64;
+const int BIG_RESP = 256 * 1024;
+
+atomic<bool> g_running{ false };
+SharedBufSP g_small_body;
+SharedBufSP g_big_body;
+
+int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    inet_aton(g_ip, &addr.sin_addr);
+
+    for (int i = 0; i < 50; i++) {
+        if (connect(fd, (sockaddr*)&addr, sizeof addr) == 0) {
+            return fd;
+        }
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    assert(false);
+    return -1;
+}
+
+/// 发送一行请求并读完resp_len字节的响应
+bool request(int fd, const char *line, int resp_len, char *buf)
+{
+    if (write(fd, line, 2) != 2) {
+        return false;
+    }
+    int got = 0;
+    while (got < resp_len) {
+        ssize_t n = read(fd, buf, min(resp_len - got, BIG_RESP));
+        if (n <= 0) {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+void on_message(const TcpConnSP& conn, InputBuffer *ibuf)
+{
+    while (ibuf->length() >= 2) {
+        const char *data = ibuf->get_from_buf();
+        conn->send(data[0] == 'B' ? g_big_body : g_small_body);
+        ibuf->pop(2);
+    }
+}
+
+void client(const char *line, int resp_len, vector<double> *latency)
+{
+    int fd = connect_server();
+    vector<char> buf(BIG_RESP);
+    while (g_running) {
+        auto t1 = Clock::now();
+        if (!request(fd, line, resp_len, buf.data())) {
+            break;
+        }
+        latency->push_back(chrono::duration<double, micro>(Clock::now() - t1).count());
+    }
+    close(fd);
+}
+
+void run(const char *name, PollerType type, int io_threads, int seconds, int conns, bool big)
+{
+    //acceptor所在loop也用同样的后端，io_uring时用多次触发的accept
+    EventLoop base_loop(type);
+    TcpServer server(&base_loop, g_ip, g_port, type);
+    server.set_thread_num(io_threads);
+    server.set_tcp_conn_timeout_ms(60000);
+    server.set_message_cb(on_message);
+    server.start();
+    thread base_thread([&base_loop](){ base_loop.loop(); });
+    g_running = true;
+
+    uint64_t wakeups = server.wakeup_count();
+    auto t1 = Clock::now();
+    vector<vector<double>> latency(conns);
+    vector<thread> clients;
+    for (auto& lat : latency) {
+        clients.emplace_back(client, big ? "B\n" : "S\n", big ? BIG_RESP : SMALL_RESP, &lat);
+    }
+    this_thread::sleep_for(chrono::seconds(seconds));
+    g_running = false;
+    for (auto& t : clients) {
+        t.join();
+    }
+    double sec = chrono::duration<double>(Clock::now() - t1).count();
+    wakeups = server.wakeup_count() - wakeups;
+
+    vector<double> all;
+    for (auto& lat : latency) {
+        all.insert(all.end(), lat.begin(), lat.end());
+    }
+    sort(all.begin(), all.end());
+    auto pct = [&all](double p) { return all.empty() ? 0.0 : all[min(all.size() - 1, (size_t)(all.size() * p))]; };
+    double mbps = all.size() * (double)(big ? BIG_RESP : SMALL_RESP) / sec / (1 << 20);
+    PR_INFO("[%-8s %-7s conns %2d] %9.0f req/s, %8.1f MB/s, p50 %5.0f us, p99 %6.0f us, wakeups/req %.2f\n",
+                name, base_loop.poller_type() == PollerType::IoUring ? "uring" : "epoll", conns,
+                all.size() / sec, mbps, pct(0.5), pct(0.99), all.empty() ? 0.0 : (double)wakeups / all.size());
+
+    base_loop.quit();
+    base_thread.join();
+    g_port++;
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+    int io_threads = argc > 1 ? atoi(argv[1]) : 4;
+    int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    g_small_body = make_shared_buf(string(SMALL_RESP, 's'));
+    g_big_body = make_shared_buf(string(BIG_RESP, 'b'));
+
+    const PollerType types[] = { PollerType::Epoll, PollerType::IoUring };
+    for (PollerType type : types) {
+        run("small", type, io_threads, seconds, 1, false);
+    }
+    for (PollerType type : types) {
+        run("small", type, io_threads, seconds, 16, false);
+    }
+    for (PollerType type : types) {
+        run("big", type, io_threads, seconds, 4, true);
+    }
+    return 0;
+}
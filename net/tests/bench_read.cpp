@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tcp_server.h"
+#include "event_loop.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_read [每个连接发送的MB数] [连接数]
+// 多个客户端线程以16K为单位不停写入，服务器的消息回调只丢弃数据，统计不同读预算下的吞吐、
+// 每MB数据的read/readv/ioctl系统调用次数、io线程的唤醒次数，以及每次消息回调平均处理的字节数。
+// 系统调用通过在本程序中定义同名函数拦截计数，再用syscall转给内核
+
+atomic<long long> g_readv_cnt{ 0 };
+atomic<long long> g_read_cnt{ 0 };
+atomic<long long> g_ioctl_cnt{ 0 };
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    g_readv_cnt.fetch_add(1, memory_order_relaxed);
+    return syscall(SYS_readv, fd, iov, iovcnt);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+    g_read_cnt.fetch_add(1, memory_order_relaxed);
+    return syscall(SYS_read, fd, buf, count);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    g_ioctl_cnt.fetch_add(1, memory_order_relaxed);
+    va_list ap;
+    va_start(ap, request);
+    void *arg = va_arg(ap, void*);
+    va_end(ap);
+    return syscall(SYS_ioctl, fd, request, arg);
+}
+
+const char *g_ip = "127.0.0.1";
+uint16_t g_port = 8891;
+
+const int WRITE_SIZE = 16 * 1024;
+
+int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    inet_aton(g_ip, &addr.sin_addr);
+
+    for (int i = 0; i < 50; i++) {
+        if (connect(fd, (sockaddr*)&addr, sizeof addr) == 0) {
+            return fd;
+        }
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    assert(false);
+    return -1;
+}
+
+void blast(long long total)
+{
+    int fd = connect_server();
+    string data(WRITE_SIZE, 'x');
+    long long sent = 0;
+    while (sent < total) {
+        ssize_t n = write(fd, data.data(), min<long long>(data.size(), total - sent));
+        assert(n > 0);
+        sent += n;
+    }
+    close(fd);
+}
+
+void run(const char *name, int budget, long long per_conn, int conns)
+{
+    EventLoop base_loop;
+    TcpServer server(&base_loop, g_ip, g_port);
+    atomic<long long> received{ 0 };
+    atomic<long long> callbacks{ 0 };
+    server.set_tcp_conn_timeout_ms(60000);
+    server.set_read_budget(budget);
+    server.set_message_cb([&received, &callbacks](const TcpConnSP&, InputBuffer *ibuf){
+        received.fetch_add(ibuf->length(), memory_order_relaxed);
+        callbacks.fetch_add(1, memory_order_relaxed);
+        ibuf->pop(ibuf->length());
+    });
+    server.set_thread_num(1);
+    server.start();
+    thread base_thread([&base_loop](){ base_loop.loop(); });
+
+    long long total = per_conn * conns;
+    long long rv1 = g_readv_cnt, r1 = g_read_cnt, io1 = g_ioctl_cnt;
+    uint64_t w1 = server.wakeup_count();
+    auto t1 = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (int i = 0; i < conns; i++) {
+        clients.emplace_back(blast, per_conn);
+    }
+    for (auto& t : clients) {
+        t.join();
+    }
+    while (received.load() < total) {
+        this_thread::yield();
+    }
+    auto t2 = chrono::steady_clock::now();
+    uint64_t w2 = server.wakeup_count();
+    long long rv2 = g_readv_cnt, r2 = g_read_cnt, io2 = g_ioctl_cnt;
+    assert(received.load() == total);
+
+    double mb = total / 1048576.0;
+    PR_INFO("[%-9s] %.0f MB/s, per MB: readv %.1f, read %.1f, ioctl %.1f, wakeups %.1f, %.0f KB/callback\n",
+                name, mb / chrono::duration<double>(t2 - t1).count(),
+                (rv2 - rv1) / mb, (r2 - r1) / mb, (io2 - io1) / mb, (w2 - w1) / mb,
+                total / 1024.0 / callbacks.load());
+
+    base_loop.quit();
+    base_thread.join();
+    g_port++;
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+    long long per_conn = (argc > 1 ? atoll(argv[1]) : 256) * 1048576;
+    int conns = argc > 2 ? atoi(argv[2]) : 4;
+
+    run("16K", 16 * 1024, per_conn, conns);
+    run("256K", 256 * 1024, per_conn, conns);
+    run("unlimited", INT_MAX, per_conn, conns);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "event_loop.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_task_queue [生产者线程数] [每个线程投递的任务数]
+// 1. 多个线程同时向一个EventLoop投递任务，统计每秒投递的任务数、每次唤醒执行的任务数，
+//    以及投递时的内存分配次数。每个任务和连接转交一样捕获一个shared_ptr，并检查同一个生产者的任务按顺序执行。
+//    生产者快于loop时环形队列会满，溢出队列会分配内存
+// 2. 一个线程投递一个任务后等待它执行完再投递下一个，模拟acceptor转交连接，统计延迟和内存分配次数
+
+atomic<long long> g_alloc_cnt{ 0 };
+
+void* operator new(size_t size)
+{
+    g_alloc_cnt.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size)) {
+        return p;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+struct BenchState {
+    vector<int> last_seq;       /// 只在loop线程中访问
+    long long executed{ 0 };
+    long long total{ 0 };
+    atomic<bool> done{ false };
+};
+
+void bench_handoff(EventLoop& loop, int cnt)
+{
+    auto conn = make_shared<int>(0);
+    atomic<int> executed{ 0 };
+
+    uint64_t w1 = loop.wakeup_count();
+    long long a1 = g_alloc_cnt.load();
+    auto t1 = chrono::steady_clock::now();
+    for (int i = 0; i < cnt; i++) {
+        loop.add_task([conn, &executed](){ executed.fetch_add(1, memory_order_release); });
+        while (executed.load(memory_order_acquire) != i + 1) {
+            this_thread::yield();
+        }
+    }
+    auto t2 = chrono::steady_clock::now();
+    long long a2 = g_alloc_cnt.load();
+    uint64_t w2 = loop.wakeup_count();
+
+    PR_INFO("handoff, tasks %d, %.2f us/task, %.2f wakeups/task, %.3f allocs/task\n", cnt,
+                chrono::duration<double, micro>(t2 - t1).count() / cnt, (double)(w2 - w1) / cnt,
+                (double)(a2 - a1) / cnt);
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+
+    int producers = argc > 1 ? atoi(argv[1]) : 4;
+    int per_producer = argc > 2 ? atoi(argv[2]) : 500000;
+
+    EventLoop loop;
+    thread loop_thread([&loop](){ loop.loop(); });
+    //等待loop开始运行，之后的任务都走跨线程路径
+    atomic<bool> started{ false };
+    loop.add_task([&started](){ started = true; });
+    while (!started) {
+        this_thread::yield();
+    }
+
+    BenchState state;
+    state.last_seq.assign(producers, -1);
+    state.total = (long long)producers * per_producer;
+    auto conn = make_shared<int>(0);
+
+    uint64_t w1 = loop.wakeup_count();
+    long long a1 = g_alloc_cnt.load();
+    auto t1 = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&loop, &state, conn, p, per_producer](){
+            for (int seq = 0; seq < per_producer; seq++) {
+                loop.add_task([conn, st = &state, p, seq](){
+                    assert(st->last_seq[p] + 1 == seq);
+                    st->last_seq[p] = seq;
+                    if (++st->executed == st->total) {
+                        st->done.store(true, memory_order_release);
+                    }
+                });
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    long long a2 = g_alloc_cnt.load();
+    while (!state.done.load(memory_order_acquire)) {
+        this_thread::yield();
+    }
+    auto t2 = chrono::steady_clock::now();
+    uint64_t w2 = loop.wakeup_count();
+
+    double sec = chrono::duration<double>(t2 - t1).count();
+    PR_INFO("producers %d, tasks %lld, %.0f tasks/s, wakeups %llu, %.1f tasks/wakeup, %.3f allocs/task\n",
+                producers, state.total, state.total / sec, (unsigned long long)(w2 - w1),
+                (double)state.total / max<uint64_t>(w2 - w1, 1), (double)(a2 - a1) / state.total);
+
+    bench_handoff(loop, 100000);
+
+    loop.quit();
+    loop_thread.join();
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "http_bench_server.h"
+#include "event_loop.h"
+#include "pr.h"
+#include "log.h"
+
+using namespace std;
+
+// 用法: bench_wakeups [每种场景的请求次数]
+// 在http_for_bench的服务器上统计每个请求/响应周期中io线程从epoll_wait返回的次数和平均延迟。
+// 同一次唤醒中可读、可写都要处理，对端半关闭时不需要再等一次读事件。
+// 大响应分别用共享响应体和每次拷贝响应体测试。
+// deferred场景在消息回调之外（loop中的任务里）发送响应，模拟异步后端的回复。
+// 服务器的epoll_ctl、readv、writev在本程序中定义同名函数拦截计数，统计每个请求的系统调用次数，客户端只用read/write
+
+atomic<long long> g_ctl_cnt{ 0 };
+atomic<long long> g_readv_cnt{ 0 };
+atomic<long long> g_writev_cnt{ 0 };
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    g_ctl_cnt.fetch_add(1, memory_order_relaxed);
+    return syscall(SYS_epoll_ctl, epfd, op, fd, event);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    g_readv_cnt.fetch_add(1, memory_order_relaxed);
+    return syscall(SYS_readv, fd, iov, iovcnt);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    g_writev_cnt.fetch_add(1, memory_order_relaxed);
+    return syscall(SYS_writev, fd, iov, iovcnt);
+}
+
+const char *g_ip = "127.0.0.1";
+uint16_t g_port = 8883;
+
+typedef chrono::steady_clock Clock;
+
+int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    inet_aton(g_ip, &addr.sin_addr);
+
+    for (int i = 0; i < 50; i++) {
+        if (connect(fd, (sockaddr*)&addr, sizeof addr) == 0) {
+            return fd;
+        }
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    assert(false);
+    return -1;
+}
+
+void write_all(int fd, const string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+        assert(n > 0);
+        sent += n;
+    }
+}
+
+/// 读到len个字节或者对端关闭为止
+size_t read_n(int fd, size_t len)
+{
+    static char buf[64 * 1024];
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, buf, min(sizeof buf, len - got));
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    return got;
+}
+
+string expect_response(const string& body)
+{
+    HttpResponse resp;
+    resp.set_content_type("text/html");
+    resp.set_body(body);
+    string out;
+    resp.append_to(out, true);
+    return out;
+}
+
+/// 每个周期发送pipeline个请求，再读完全部响应，返回每个请求的唤醒次数
+double run_cycles(HttpBenchServer& server, const char *name, int cycles, int pipeline)
+{
+    string req;
+    for (int i = 0; i < pipeline; i++) {
+        req.append("GET /bench HTTP/1.1\r\nHost: bench\r\n\r\n");
+    }
+    size_t resp_len = expect_response(server.get_body()).size() * pipeline;
+
+    int fd = connect_server();
+    //先完成一个周期，连接已经注册到子loop中
+    write_all(fd, req);
+    assert(read_n(fd, resp_len) == resp_len);
+
+    uint64_t w1 = server.get_tcp_server()->wakeup_count();
+    long long ctl1 = g_ctl_cnt, readv1 = g_readv_cnt, writev1 = g_writev_cnt;
+    auto t1 = Clock::now();
+    for (int i = 0; i < cycles; i++) {
+        write_all(fd, req);
+        assert(read_n(fd, resp_len) == resp_len);
+    }
+    auto t2 = Clock::now();
+    uint64_t w2 = server.get_tcp_server()->wakeup_count();
+    long long ctl = g_ctl_cnt - ctl1, rv = g_readv_cnt - readv1, wv = g_writev_cnt - writev1;
+    close(fd);
+
+    double reqs = (double)cycles * pipeline;
+    PR_INFO("[%-10s] response %zu bytes, requests %.0f, wakeups/request %.2f, latency %.1f us/cycle\n",
+                name, resp_len / pipeline, reqs, (w2 - w1) / reqs,
+                chrono::duration<double, micro>(t2 - t1).count() / cycles);
+    PR_INFO("[%-10s] syscalls/request %.2f: epoll_wait %.2f, epoll_ctl %.2f, readv %.2f, writev %.2f\n",
+                name, (w2 - w1 + ctl + rv + wv) / reqs, (w2 - w1) / reqs, ctl / reqs, rv / reqs, wv / reqs);
+    return (w2 - w1) / reqs;
+}
+
+/// 发送请求后立即关闭写方向，服务器发完响应后关闭连接
+void run_half_close(HttpBenchServer& server, int cycles)
+{
+    string req = "GET /bench HTTP/1.1\r\nHost: bench\r\n\r\n";
+    string expect = expect_response(server.get_body());
+
+    uint64_t w1 = server.get_tcp_server()->wakeup_count();
+    long long ctl1 = g_ctl_cnt;
+    auto t1 = Clock::now();
+    for (int i = 0; i < cycles; i++) {
+        int fd = connect_server();
+        write_all(fd, req);
+        shutdown(fd, SHUT_WR);
+        assert(read_n(fd, expect.size() + 1) == expect.size());
+        close(fd);
+    }
+    auto t2 = Clock::now();
+    for (int i = 0; i < 100 && server.get_tcp_server()->conn_count() != 0; i++) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    assert(server.get_tcp_server()->conn_count() == 0);
+    uint64_t w2 = server.get_tcp_server()->wakeup_count();
+
+    PR_INFO("[%-10s] connections %d, wakeups/connection %.2f, epoll_ctl/connection %.2f, latency %.1f us/connection\n",
+                "half-close", cycles, (w2 - w1) / (double)cycles, (g_ctl_cnt - ctl1) / (double)cycles,
+                chrono::duration<double, micro>(t2 - t1).count() / cycles);
+}
+
+/// 消息回调只丢弃请求，响应在之后的任务中发送，这时send不在消息回调中
+void run_deferred(int cycles)
+{
+    EventLoop base_loop;
+    TcpServer server(&base_loop, g_ip, g_port);
+    server.set_thread_num(1);
+    server.set_tcp_conn_timeout_ms(60000);
+    string resp = expect_response("deferred");
+    server.set_message_cb([&resp](const TcpConnSP& conn, InputBuffer *ibuf) {
+        ibuf->pop(ibuf->length());
+        conn->getLoop()->queue_task([conn, &resp](){ conn->send(resp.data(), resp.size()); });
+    });
+    server.start();
+    thread base_thread([&base_loop](){ base_loop.loop(); });
+
+    string req = "GET /bench HTTP/1.1\r\nHost: bench\r\n\r\n";
+    int fd = connect_server();
+    write_all(fd, req);
+    assert(read_n(fd, resp.size()) == resp.size());
+
+    uint64_t w1 = server.wakeup_count();
+    long long ctl1 = g_ctl_cnt, readv1 = g_readv_cnt, writev1 = g_writev_cnt;
+    auto t1 = Clock::now();
+    for (int i = 0; i < cycles; i++) {
+        write_all(fd, req);
+        assert(read_n(fd, resp.size()) == resp.size());
+    }
+    auto t2 = Clock::now();
+    uint64_t w2 = server.wakeup_count();
+    long long ctl = g_ctl_cnt - ctl1, rv = g_readv_cnt - readv1, wv = g_writev_cnt - writev1;
+    close(fd);
+
+    PR_INFO("[%-10s] requests %d, wakeups/request %.2f, latency %.1f us/cycle\n",
+                "deferred", cycles, (w2 - w1) / (double)cycles, chrono::duration<double, micro>(t2 - t1).count() / cycles);
+    PR_INFO("[%-10s] syscalls/request %.2f: epoll_wait %.2f, epoll_ctl %.2f, readv %.2f, writev %.2f\n",
+                "deferred", (w2 - w1 + ctl + rv + wv) / (double)cycles, (w2 - w1) / (double)cycles,
+                ctl / (double)cycles, rv / (double)cycles, wv / (double)cycles);
+
+    base_loop.quit();
+    base_thread.join();
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::get_instance()->init(NULL, 0, Logger::LOG_LEVEL_ERROR);
+    int cycles = argc > 1 ? atoi(argv[1]) : 2000;
+
+    {
+        EventLoop base_loop;
+        HttpBenchServer server(&base_loop, g_ip, g_port);
+        server.set_tcp_cn_timeout_ms(60000);
+        server.start(1);
+        thread base_thread([&base_loop](){ base_loop.loop(); });
+
+        //一个小请求的读和回复在同一次唤醒中完成
+        double wakeups = run_cycles(server, "small", cycles, 1);
+        assert(wakeups < 1.1);
+        run_cycles(server, "pipeline", cycles, 4);
+        run_half_close(server, cycles / 10 + 1);
+
+        base_loop.quit();
+        base_thread.join();
+    }
+    for (bool shared : { true, false }) {
+        EventLoop base_loop;
+        g_port++;
+        HttpBenchServer server(&base_loop, g_ip, g_port);
+        server.set_tcp_cn_timeout_ms(60000);
+        server.set_body(string(256 * 1024, 'x'));
+        server.set_shared_body(shared);
+        server.start(1);
+        thread base_thread([&base_loop](){ base_loop.loop(); });
+
+        run_cycles(server, shared ? "large" : "large-copy", cycles / 10 + 1, 1);
+        run_cycles(server, shared ? "large-pipe" : "pipe-copy", cycles / 10 + 1, 2);
+
+        base_loop.quit();
+        base_thread.join();
+    }
+    g_port++;
+    run_deferred(cycles);
+    return 0;
+}
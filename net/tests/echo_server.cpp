@@ -30,7 +30,6 @@ private:
         const char *msg = ibuf->get_from_buf();
         string msg_str(msg, msg+ibuf->length());
         ibuf->pop(ibuf->length());
-        ibuf->adjust();
     
         PR_INFO("socket fd %d recv message:%s", conn->get_fd(), msg_str.c_str());
 
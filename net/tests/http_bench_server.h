@@ -0,0 +1,50 @@
+#ifndef __HTTP_BENCH_SERVER_H__
+#define __HTTP_BENCH_SERVER_H__
+
+#include <string>
+
+#include "http_server.h"
+
+/// http_for_bench和bench_wakeups共用的压测服务器，对所有请求返回同一个页面
+class HttpBenchServer
+{
+public:
+    HttpBenchServer(EventLoop* loop, const char *ip, uint16_t port, PollerType poller = PollerType::Epoll) :
+            hb_server(loop, ip, port, poller), hb_loop(loop)
+    {
+        set_body("<html><head><title>my title</title><body>Hello World!</body></head></html>");
+        hb_server.set_http_cb([this](const HttpRequest& req, HttpResponse* resp){ this->bench_http_cb(req, resp); });
+    };
+
+    ~HttpBenchServer() {};
+
+    void start(int thread_num) { hb_server.set_thread_num(thread_num); hb_server.start(); }
+
+    void set_tcp_cn_timeout_ms(int ms) { hb_server.set_tcp_conn_timeout_ms(ms); }
+    ///替换响应体，用于测试大响应，必须在start之前设置
+    void set_body(const string& body) { hb_body = body; hb_shared_body = make_shared_buf(body); }
+    const string& get_body() const { return hb_body; }
+    ///默认所有连接共享同一个响应体缓冲区，关闭后每个响应拷贝一次响应体，必须在start之前设置
+    void set_shared_body(bool on) { hb_shared = on; }
+
+    TcpServer* get_tcp_server() { return hb_server.get_tcp_server(); }
+
+private:
+    void bench_http_cb(const HttpRequest&, HttpResponse* resp) {
+        resp->set_content_type("text/html");
+        if (hb_shared) {
+            resp->set_body(hb_shared_body);
+        }
+        else {
+            resp->set_body(hb_body);
+        }
+    }
+
+    HttpServer hb_server;
+    EventLoop *hb_loop;
+    string hb_body;
+    SharedBufSP hb_shared_body;
+    bool hb_shared{ true };
+};
+
+#endif
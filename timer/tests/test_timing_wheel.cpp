@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <assert.h>
+#include <vector>
+
+#include "timing_wheel.h"
+#include "pr.h"
+
+using namespace std;
+
+/// 所有用例都显式传入当前时间，结果与机器快慢无关
+void test_expire_order()
+{
+    TimingWheel wheel(10, 64, 0);
+    vector<int> fired;
+    TimingWheel::Node a, b, c;
+    a.tn_callback = [&fired]{ fired.push_back(1); };
+    b.tn_callback = [&fired]{ fired.push_back(2); };
+    c.tn_callback = [&fired]{ fired.push_back(3); };
+
+    wheel.add(&a, 30, 0);
+    wheel.add(&b, 15, 0);
+    wheel.add(&c, 1000, 0);     //超过一圈
+    assert(wheel.size() == 3);
+    assert(wheel.next_timeout_ms(0) == 20);
+
+    assert(wheel.advance(19) == 0);
+    assert(wheel.advance(20) == 1);
+    assert(fired.size() == 1 && fired[0] == 2);
+    assert(wheel.next_timeout_ms(20) == 10);
+
+    assert(wheel.advance(640) == 1);    //c所在的槽已经转过，但还没到期
+    assert(fired.size() == 2 && fired[1] == 1);
+    assert(c.is_linked());
+    assert(wheel.advance(999) == 0);
+    assert(wheel.advance(1000) == 1);
+    assert(fired.size() == 3 && fired[2] == 3);
+    assert(wheel.size() == 0);
+    assert(wheel.next_timeout_ms(1000) == -1);
+
+    PR_INFO("expire order test passed!\n");
+}
+
+/// 刷新和取消都不触发回调
+void test_refresh_and_cancel()
+{
+    TimingWheel wheel(10, 64, 0);
+    int cnt = 0;
+    TimingWheel::Node node;
+    node.tn_callback = [&cnt]{ cnt++; };
+
+    wheel.add(&node, 50, 0);
+    for (int now = 10; now <= 200; now += 10) {
+        wheel.advance(now);
+        wheel.add(&node, 50, now);  //模拟连接上不断有数据到达
+    }
+    assert(cnt == 0);
+    assert(wheel.size() == 1);
+
+    wheel.cancel(&node);
+    assert(!node.is_linked());
+    assert(wheel.size() == 0);
+    assert(wheel.advance(1000) == 0);
+    assert(cnt == 0);
+
+    wheel.add(&node, 50, 1000);
+    assert(wheel.advance(1050) == 1);
+    assert(cnt == 1);
+
+    PR_INFO("refresh and cancel test passed!\n");
+}
+
+/// 回调中取消同一轮到期的其他节点、重新添加自己
+void test_modify_in_callback()
+{
+    TimingWheel wheel(10, 64, 0);
+    int a_cnt = 0, b_cnt = 0;
+    TimingWheel::Node a, b;
+    a.tn_callback = [&]{ a_cnt++; wheel.cancel(&b); wheel.add(&a, 100, 100); };
+    b.tn_callback = [&]{ b_cnt++; };
+
+    wheel.add(&a, 50, 0);
+    wheel.add(&b, 60, 0);
+    assert(wheel.advance(100) == 1);
+    assert(a_cnt == 1 && b_cnt == 0);
+    assert(a.is_linked() && !b.is_linked());
+    assert(wheel.size() == 1);
+
+    assert(wheel.advance(200) == 1);
+    assert(a_cnt == 2);
+
+    PR_INFO("modify in callback test passed!\n");
+}
+
+void test_run_after()
+{
+    TimingWheel wheel(10, 64, 0);
+    int sum = 0;
+    for (int i = 1; i <= 100; i++) {
+        wheel.run_after(i * 7, [&sum, i]{ sum += i; }, 0);
+    }
+    assert(wheel.size() == 100);
+    assert(wheel.advance(350) == 50);
+    assert(sum == 50 * 51 / 2);
+    assert(wheel.advance(5000) == 50);
+    assert(sum == 100 * 101 / 2);
+
+    //未到期的一次性节点由时间轮析构时释放
+    wheel.run_after(10, []{}, 5000);
+
+    PR_INFO("run after test passed!\n");
+}
+
+int main()
+{
+    test_expire_order();
+    test_refresh_and_cancel();
+    test_modify_in_callback();
+    test_run_after();
+
+    PR_INFO("timing wheel test passed!\n");
+    return 0;
+}
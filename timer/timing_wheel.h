@@ -0,0 +1,207 @@
+#ifndef __TIMING_WHEEL_H__
+#define __TIMING_WHEEL_H__
+
+#include <stdint.h>
+#include <assert.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+/// 哈希时间轮，每个EventLoop一个，只在loop线程中使用，不加锁。
+/// 定时器节点是侵入式双向链表节点，可以直接嵌入到使用者对象中（比如TcpConnection），
+/// 添加、刷新、取消都是O(1)，刷新超时时间不需要分配内存。
+/// 节点按到期tick哈希到槽中，超过一圈的节点留在槽里，转到时比较到期tick即可。
+class TimingWheel {
+public:
+    typedef function<void()> Callback;
+
+    struct Node {
+        Node *tn_prev{ nullptr };
+        Node *tn_next{ nullptr };
+        int64_t tn_expire_tick{ 0 };
+        bool tn_owned{ false };     /// 由时间轮分配，回调执行后释放
+        bool tn_pending{ false };   /// 已到期，等待执行回调
+        Callback tn_callback;
+
+        bool is_linked() const { return tn_next != nullptr; }
+    };
+
+    static int64_t now_ms() {
+        return chrono::duration_cast<chrono::milliseconds>(
+                    chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// slot_num必须是2的幂
+    explicit TimingWheel(int tick_ms = 10, int slot_num = 512, int64_t now = now_ms())
+        : tw_tick_ms(tick_ms), tw_mask(slot_num - 1), tw_slots(slot_num), tw_bitmap((slot_num + 63) / 64, 0)
+    {
+        assert(tick_ms > 0 && slot_num > 0 && (slot_num & (slot_num - 1)) == 0);
+        for (auto& s : tw_slots) {
+            s.tn_prev = s.tn_next = &s;
+        }
+        tw_current_tick = now / tw_tick_ms;
+    }
+
+    ~TimingWheel() {
+        for (auto& s : tw_slots) {
+            while (s.tn_next != &s) {
+                Node *node = s.tn_next;
+                unlink(node);
+                if (node->tn_owned) {
+                    delete node;
+                }
+            }
+        }
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    /// 添加节点，节点已经在时间轮中时相当于刷新超时时间
+    void add(Node *node, int ms, int64_t now = now_ms()) {
+        //向上取整，保证不会提前超时
+        int64_t expire = (now + ms + tw_tick_ms - 1) / tw_tick_ms;
+        if (expire <= tw_current_tick) {
+            expire = tw_current_tick + 1;
+        }
+        if (node->is_linked()) {
+            if (!node->tn_pending && node->tn_expire_tick == expire) {
+                return;
+            }
+            detach(node);
+        }
+        node->tn_expire_tick = expire;
+        link(&tw_slots[expire & tw_mask], node);
+        set_bit(expire & tw_mask);
+        tw_size++;
+    }
+
+    /// 分配一个一次性的定时器节点，回调执行后自动释放
+    void run_after(int ms, Callback&& cb, int64_t now = now_ms()) {
+        Node *node = new Node();
+        node->tn_owned = true;
+        node->tn_callback = move(cb);
+        add(node, ms, now);
+    }
+
+    void cancel(Node *node) {
+        if (node->is_linked()) {
+            detach(node);
+        }
+    }
+
+    size_t size() const { return tw_size; }
+
+    /// 距离下一个非空槽到期的毫秒数，时间轮为空时返回-1
+    int next_timeout_ms(int64_t now = now_ms()) const {
+        if (tw_size == 0) {
+            return -1;
+        }
+        int slot_num = tw_mask + 1;
+        for (int i = 1; i <= slot_num; i++) {
+            int64_t tick = tw_current_tick + i;
+            int index = tick & tw_mask;
+            //整个64位为0时直接跳过
+            if (tw_bitmap[index >> 6] == 0 && (index & 63) == 0 && i + 63 <= slot_num) {
+                i += 63;
+                continue;
+            }
+            if (tw_bitmap[index >> 6] & (1ULL << (index & 63))) {
+                int64_t ms = tick * tw_tick_ms - now;
+                return ms > 0 ? static_cast<int>(ms) : 0;
+            }
+        }
+        return tw_tick_ms * slot_num;
+    }
+
+    /// 推进到now，执行所有到期节点的回调，返回执行的回调个数
+    int advance(int64_t now = now_ms()) {
+        int64_t target = now / tw_tick_ms;
+        if (target <= tw_current_tick) {
+            return 0;
+        }
+
+        //先把到期节点摘到临时链表中，回调中可以安全地添加或取消其他节点
+        Node expired;
+        expired.tn_prev = expired.tn_next = &expired;
+        int64_t ticks = target - tw_current_tick;
+        int slot_num = tw_mask + 1;
+        for (int64_t i = 1; i <= ticks && i <= slot_num; i++) {
+            int index = (tw_current_tick + i) & tw_mask;
+            Node *head = &tw_slots[index];
+            for (Node *node = head->tn_next; node != head; ) {
+                Node *next = node->tn_next;
+                if (node->tn_expire_tick <= target) {
+                    unlink(node);
+                    node->tn_pending = true;
+                    link(&expired, node);
+                }
+                node = next;
+            }
+        }
+        tw_current_tick = target;
+
+        int cnt = 0;
+        while (expired.tn_next != &expired) {
+            Node *node = expired.tn_next;
+            detach(node);
+            cnt++;
+            //嵌入在使用者对象中的节点可能在回调中随对象一起析构，回调之后不能再访问
+            bool owned = node->tn_owned;
+            if (node->tn_callback) {
+                node->tn_callback();
+            }
+            if (owned) {
+                delete node;
+            }
+        }
+        return cnt;
+    }
+
+private:
+    void link(Node *head, Node *node) {
+        node->tn_prev = head->tn_prev;
+        node->tn_next = head;
+        head->tn_prev->tn_next = node;
+        head->tn_prev = node;
+    }
+
+    /// 从所在链表中摘除节点，节点可能在槽中，也可能在advance的到期链表中
+    void detach(Node *node) {
+        if (node->tn_pending) {
+            node->tn_prev->tn_next = node->tn_next;
+            node->tn_next->tn_prev = node->tn_prev;
+            node->tn_prev = node->tn_next = nullptr;
+            node->tn_pending = false;
+        }
+        else {
+            unlink(node);
+        }
+    }
+
+    /// 从槽中摘除节点，同时维护非空槽位图和节点数
+    void unlink(Node *node) {
+        node->tn_prev->tn_next = node->tn_next;
+        node->tn_next->tn_prev = node->tn_prev;
+        int index = node->tn_expire_tick & tw_mask;
+        Node *head = &tw_slots[index];
+        if (head->tn_next == head) {
+            tw_bitmap[index >> 6] &= ~(1ULL << (index & 63));
+        }
+        node->tn_prev = node->tn_next = nullptr;
+        tw_size--;
+    }
+
+    void set_bit(int index) { tw_bitmap[index >> 6] |= 1ULL << (index & 63); }
+
+    int tw_tick_ms;
+    int64_t tw_mask;
+    int64_t tw_current_tick;
+    size_t tw_size{ 0 };
+    vector<Node> tw_slots;          /// 每个槽一个哨兵节点
+    vector<uint64_t> tw_bitmap;     /// 非空槽位图，用来快速计算下一次超时
+};
+
+#endif